@@ -0,0 +1,243 @@
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "level.h"
+#include "simd.h"
+
+// raycast-bake: check a level for mistakes that don't stop it from loading but
+//	make it render or play wrong, then write it out baked in the binary format
+//	(or only check it, if there's no output file)
+
+static int errors, warnings;
+
+static void report(bool error, const struct sector *sector, const char *format, ...)
+	__attribute__((format(printf, 3, 4)));
+
+static void report(bool error, const struct sector *sector, const char *format, ...) {
+	va_list args;
+	va_start(args, format);
+	fprintf(stderr, "%s: sector %d: ", error ? "error" : "warning", sector->id);
+	vfprintf(stderr, format, args);
+	fputc('\n', stderr);
+	va_end(args);
+
+	if (error) errors++;
+	else warnings++;
+}
+
+// which side of the line through a wall a point is on: positive inside (on
+//	the right looking from a to b, see pointInEdges()), 0 on the line
+static int64_t side(const struct wall *wall, vect2i p) {
+	return (int64_t) (p.x - wall->a.x) * (wall->b.y - wall->a.y)
+		- (int64_t) (p.y - wall->a.y) * (wall->b.x - wall->a.x);
+}
+
+static int comparePoints(const void *a, const void *b) {
+	const vect2i *p = a, *q = b;
+	if (p->x != q->x) return p->x < q->x ? -1 : 1;
+	if (p->y != q->y) return p->y < q->y ? -1 : 1;
+	return 0;
+}
+
+// walls have to join up into a loop: every point a wall ends at is where
+//	another one starts, as many times
+static bool checkClosed(const struct sector *sector, const struct wall *walls) {
+	vect2i *starts = malloc(2 * sector->numwalls * sizeof(vect2i));
+	if (!starts) return true; // can't tell
+	vect2i *ends = starts + sector->numwalls;
+
+	for (uint32_t j = 0; j < sector->numwalls; j++) {
+		starts[j] = walls[j].a;
+		ends[j] = walls[j].b;
+	}
+	qsort(starts, sector->numwalls, sizeof(vect2i), comparePoints);
+	qsort(ends, sector->numwalls, sizeof(vect2i), comparePoints);
+
+	bool closed = true;
+	for (uint32_t j = 0; j < sector->numwalls && closed; j++) {
+		if (comparePoints(&starts[j], &ends[j])) {
+			const vect2i p = comparePoints(&starts[j], &ends[j]) < 0 ? starts[j] : ends[j];
+			report(true, sector, "walls don't form a closed loop, (%d, %d) is the "
+				"start of a different number of walls than it's the end of", p.x, p.y);
+			closed = false;
+		}
+	}
+
+	free(starts);
+	return closed;
+}
+
+static void checkSector(const struct level *level, const struct sector *sector) {
+	const struct wall *walls = sectorWalls(level, sector);
+
+	if (sector->numwalls < 3) {
+		report(true, sector, "has %u walls, it takes at least 3 to enclose anything",
+			sector->numwalls);
+		return;
+	}
+
+	if (sector->zfloor >= sector->zceil) {
+		report(false, sector, "floor (%g) isn't below the ceiling (%g)",
+			sector->zfloor, sector->zceil);
+	}
+
+	bool degenerate = false;
+	for (uint32_t j = 0; j < sector->numwalls; j++) {
+		if (walls[j].a.x == walls[j].b.x && walls[j].a.y == walls[j].b.y) {
+			report(true, sector, "wall %u starts and ends at (%d, %d)", j, walls[j].a.x, walls[j].a.y);
+			degenerate = true;
+		}
+	}
+	if (degenerate || !checkClosed(sector, walls)) return;
+
+	// twice the signed area, which is negative when the walls go clockwise
+	//	(with y up) so that the inside is on their right
+	int64_t area = 0;
+	for (uint32_t j = 0; j < sector->numwalls; j++) {
+		area += (int64_t) walls[j].a.x * walls[j].b.y - (int64_t) walls[j].b.x * walls[j].a.y;
+	}
+	if (area == 0) {
+		report(true, sector, "has no area");
+		return;
+	}
+	if (area > 0) {
+		report(true, sector, "walls go the wrong way around (the inside has to be on "
+			"the right of each wall, looking from its start to its end)");
+		return;
+	}
+
+	// convex: no corner is outside of any wall
+	for (uint32_t j = 0; j < sector->numwalls; j++) {
+		for (uint32_t k = 0; k < sector->numwalls; k++) {
+			if (side(&walls[j], walls[k].a) < 0) {
+				report(true, sector, "isn't convex, (%d, %d) is outside of wall %u",
+					walls[k].a.x, walls[k].a.y, j);
+				return;
+			}
+		}
+	}
+}
+
+// a portal has to be matched by one going back along the same wall, or the
+//	sector on the other side can be walked into but not out of (or seen into
+//	but not back out of)
+static void checkPortals(const struct level *level, const struct sector *sector) {
+	const struct wall *walls = sectorWalls(level, sector);
+
+	for (uint32_t j = 0; j < sector->numwalls; j++) {
+		const struct wall *wall = &walls[j];
+		if (wall->portal == SECTOR_NONE) continue;
+
+		if (wall->portal == sector->id) {
+			report(true, sector, "wall %u is a portal to its own sector", j);
+			continue;
+		}
+
+		const struct sector *other = level->sectors.arr[wall->portal];
+		const struct wall *back = NULL;
+		for (uint32_t k = 0; k < other->numwalls && !back; k++) {
+			const struct wall *w = &sectorWalls(level, other)[k];
+			if (w->a.x == wall->b.x && w->a.y == wall->b.y
+				&& w->b.x == wall->a.x && w->b.y == wall->a.y) {
+				back = w;
+			}
+		}
+
+		if (!back) {
+			report(true, sector, "wall %u is a portal to sector %d, which has no wall "
+				"from (%d, %d) to (%d, %d) to come back through", j, wall->portal,
+				wall->b.x, wall->b.y, wall->a.x, wall->a.y);
+		} else if (back->portal != sector->id) {
+			report(true, sector, "wall %u is a portal to sector %d, but that side of it "
+				"leads to %d instead of back here", j, wall->portal, back->portal);
+		}
+	}
+}
+
+// every SIMD path has to find the same points inside a sector as the scalar
+//	one, or the level plays differently from one CPU to the next. tested on
+//	the points they're likeliest to disagree on: the corners of the walls
+//	(right on two of them), their middles and the corners of the bounds
+static void checkPointPaths(const struct level *level, const struct sector *sector) {
+	const struct wall_store *store = level->walls;
+	const uint32_t first = sector->firstwall, n = 2 * sector->numwalls + 4;
+	float *px = malloc(n * sizeof(float)), *py = malloc(n * sizeof(float));
+	bool *expected = malloc(2 * n * sizeof(bool));
+	if (!px || !py || !expected) goto done; // can't tell
+	bool *inside = expected + n;
+
+	for (uint32_t j = 0; j < sector->numwalls; j++) {
+		const uint32_t a = store->edges.va[first + j], b = store->edges.vb[first + j];
+		px[2 * j] = store->verts.x[a];
+		py[2 * j] = store->verts.y[a];
+		px[2 * j + 1] = (store->verts.x[a] + store->verts.x[b]) * 0.5f;
+		py[2 * j + 1] = (store->verts.y[a] + store->verts.y[b]) * 0.5f;
+	}
+	for (uint32_t k = 0; k < 4; k++) {
+		px[n - 4 + k] = k & 1 ? sector->bounds.max.x : sector->bounds.min.x;
+		py[n - 4 + k] = k & 2 ? sector->bounds.max.y : sector->bounds.min.y;
+	}
+
+	simdUse(SIMD_SCALAR);
+	pointsInSector(level, sector, px, py, n, expected);
+
+	for (enum simd_path path = SIMD_SCALAR + 1; path < SIMD_PATHS; path++) {
+		if (simdUse(path) != path) continue; // not on this CPU
+
+		pointsInSector(level, sector, px, py, n, inside);
+		for (uint32_t k = 0; k < n; k++) {
+			if (inside[k] != expected[k]) {
+				report(true, sector, "(%g, %g) is %s on the %s path but %s on the scalar one",
+					px[k], py[k], inside[k] ? "inside" : "outside", simdPathNames[path],
+					expected[k] ? "inside" : "outside");
+				break;
+			}
+		}
+	}
+	simdInit();
+
+done:
+	free(px);
+	free(py);
+	free(expected);
+}
+
+int main(int argc, char *argv[]) {
+	if (argc != 2 && argc != 3) {
+		fprintf(stderr, "Usage: %s [input level] [baked output level]\n", argv[0]);
+		return 1;
+	}
+
+	struct level *level = NULL;
+	int status = loadLevel(argv[1], &level);
+
+	// every wall is checked, not just those of the pages near a player
+	if (status == 0 && (status = checkLevel(level)) != 0) releaseLevel(level);
+	if (status != 0) {
+		printLoadError(status);
+		return 1;
+	}
+
+	for (size_t i = 1; i < level->sectors.n; i++) {
+		checkSector(level, level->sectors.arr[i]);
+		checkPortals(level, level->sectors.arr[i]);
+		checkPointPaths(level, level->sectors.arr[i]);
+	}
+	fprintf(stderr, "Checked %zu sectors: %d errors, %d warnings\n",
+		level->sectors.n - 1, errors, warnings);
+
+	if (errors == 0 && argc == 3) {
+		status = saveLevelBinary(level, argv[2]);
+		if (status != 0) {
+			fprintf(stderr, "Error saving level file: %d\n", status);
+		} else {
+			fprintf(stderr, "Baked %zu sectors into %s\n", level->sectors.n - 1, argv[2]);
+		}
+	}
+
+	releaseLevel(level);
+	return errors != 0 || status != 0;
+}
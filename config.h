@@ -0,0 +1,24 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#define PROJECT_NAME "Raycast"
+#define SCREEN_WIDTH 384
+#define SCREEN_HEIGHT 256
+
+#define SECTOR_NONE 0
+
+// what fits through a portal: the headroom the player needs, and the highest
+//	step up they can take
+#define PLAYER_HEIGHT 1.8f
+#define STEP_HEIGHT 1.0f
+
+// megabytes of a (binary) level's walls to keep in memory around the player
+#define LEVEL_PAGE_BUDGET 64
+
+// environment variable naming a directory to cache parsed levels in
+#define LEVEL_CACHE_ENV "RAYCAST_LEVEL_CACHE"
+
+// back framebuffers big enough to span them with transparent huge pages
+#define FRAMEBUFFER_HUGE_PAGES 1
+
+#endif
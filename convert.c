@@ -0,0 +1,39 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "level.h"
+
+// raycast-convert: translate a level between JSON and the binary format; the
+//	input's format is detected, the output is JSON if its name ends in .json
+int main(int argc, char *argv[]) {
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s [input level] [output level]\n", argv[0]);
+		return 1;
+	}
+
+	struct level *level = NULL;
+	int status = loadLevel(argv[1], &level);
+
+	// every wall is converted, not just those of the pages near a player
+	if (status == 0 && (status = checkLevel(level)) != 0) releaseLevel(level);
+	if (status != 0) {
+		printLoadError(status);
+		return 1;
+	}
+
+	printLoaded(level);
+
+	const char *extension = strrchr(argv[2], '.');
+	const int json = extension && !strcmp(extension, ".json");
+
+	status = saveLevel(level, argv[2]);
+	if (status != 0) {
+		fprintf(stderr, "Error saving level file: %d\n", status);
+	} else {
+		fprintf(stderr, "Converted %zu sectors to %s\n",
+			level->sectors.n - 1, json ? "JSON" : "binary");
+	}
+
+	releaseLevel(level);
+	return status != 0;
+}
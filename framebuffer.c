@@ -0,0 +1,104 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include "config.h"
+#include "framebuffer.h"
+
+#define FRAMEBUFFER_ALIGN 64
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// framebuffers that were released, guarded by a spinlock since they're only
+//	ever held for a couple of pointer swaps
+static struct framebuffer *pool;
+static atomic_flag poolLock = ATOMIC_FLAG_INIT;
+
+static void lockPool(void) {
+	while (atomic_flag_test_and_set_explicit(&poolLock, memory_order_acquire));
+}
+
+static void unlockPool(void) {
+	atomic_flag_clear_explicit(&poolLock, memory_order_release);
+}
+
+static struct framebuffer *allocFramebuffer(int width, int height) {
+	struct framebuffer *fb = malloc(sizeof(struct framebuffer));
+	if (!fb) return NULL;
+
+	fb->width = width;
+	fb->height = height;
+	fb->pitch = (width + 15) & ~15; // whole 64 byte lines per row
+	fb->size = (size_t) fb->pitch * height * sizeof(uint32_t);
+	fb->next = NULL;
+
+	size_t align = FRAMEBUFFER_ALIGN;
+	bool huge = false;
+
+#if FRAMEBUFFER_HUGE_PAGES && defined(MADV_HUGEPAGE)
+	// big enough to span huge pages: align to them so the kernel can back the
+	//	whole buffer with as few as possible
+	if (fb->size >= HUGE_PAGE_SIZE) {
+		align = HUGE_PAGE_SIZE;
+		fb->size = (fb->size + HUGE_PAGE_SIZE - 1) & ~((size_t) HUGE_PAGE_SIZE - 1);
+		huge = true;
+	}
+#endif
+
+	void *pixels;
+	if (posix_memalign(&pixels, align, fb->size) != 0) {
+		free(fb);
+		return NULL;
+	}
+
+#if FRAMEBUFFER_HUGE_PAGES && defined(MADV_HUGEPAGE)
+	if (huge) madvise(pixels, fb->size, MADV_HUGEPAGE); // only a hint, fine if it fails
+#endif
+	(void) huge;
+
+	fb->pixels = pixels;
+	return fb;
+}
+
+struct framebuffer *acquireFramebuffer(int width, int height) {
+	lockPool();
+	for (struct framebuffer **p = &pool; *p; p = &(*p)->next) {
+		if ((*p)->width == width && (*p)->height == height) {
+			struct framebuffer *fb = *p;
+			*p = fb->next;
+			unlockPool();
+
+			fb->next = NULL;
+			return fb;
+		}
+	}
+	unlockPool();
+
+	return allocFramebuffer(width, height);
+}
+
+void releaseFramebuffer(struct framebuffer *fb) {
+	if (!fb) return;
+
+	lockPool();
+	fb->next = pool;
+	pool = fb;
+	unlockPool();
+}
+
+void drainFramebuffers(void) {
+	lockPool();
+	struct framebuffer *fb = pool;
+	pool = NULL;
+	unlockPool();
+
+	while (fb) {
+		struct framebuffer *next = fb->next;
+		free(fb->pixels);
+		free(fb);
+		fb = next;
+	}
+}
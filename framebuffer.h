@@ -0,0 +1,28 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 32-bit pixels, row after row; every row starts on a 64 byte boundary so
+//	that vectorized code can use aligned loads and stores on whole rows
+struct framebuffer {
+	uint32_t *pixels;
+	int width, height;
+	int pitch; // pixels from the start of one row to the next, at least width
+	size_t size; // bytes allocated for pixels
+
+	struct framebuffer *next; // in the pool, see releaseFramebuffer()
+};
+
+// get a framebuffer from the pool or allocate a new one, NULL if out of
+//	memory; its contents are whatever was drawn into it last
+struct framebuffer *acquireFramebuffer(int width, int height);
+
+// give a framebuffer back to the pool for acquireFramebuffer() to reuse
+void releaseFramebuffer(struct framebuffer *fb);
+
+// free all of the framebuffers in the pool
+void drainFramebuffers(void);
+
+#endif
@@ -0,0 +1,2909 @@
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "level.h"
+#include "simd.h"
+
+// every version of every level gets a unique number
+static atomic_uint nextVersion = 1;
+
+static struct sector *allocSector(unsigned version) {
+	struct sector *sector = calloc(1, sizeof(struct sector));
+	if (!sector) return NULL;
+
+	atomic_init(&sector->refs, 1);
+	sector->version = version;
+	return sector;
+}
+
+static void releaseSector(struct sector *sector) {
+	if (sector && atomic_fetch_sub(&sector->refs, 1) == 1) {
+		free(sector);
+	}
+}
+
+// make room for at least n sectors, the new slots are empty; returns 0 or
+//	-129 if out of memory
+static int reserveSectors(struct level *level, size_t n) {
+	if (n <= level->sectors.cap) return 0;
+
+	size_t cap = level->sectors.cap ? level->sectors.cap : 16;
+	while (cap < n) cap *= 2;
+
+	struct sector **arr = realloc(level->sectors.arr, cap * sizeof(struct sector *));
+	if (!arr) return -129;
+
+	memset(&arr[level->sectors.cap], 0, (cap - level->sectors.cap) * sizeof(struct sector *));
+	level->sectors.arr = arr;
+
+	// whatever was grown stays grown, it's only used once cap says so
+	uint32_t *first = realloc(level->ranges.first, cap * sizeof(uint32_t));
+	if (first) level->ranges.first = first;
+	uint32_t *num = realloc(level->ranges.num, cap * sizeof(uint32_t));
+	if (num) level->ranges.num = num;
+	uint32_t *page = realloc(level->ranges.page, cap * sizeof(uint32_t));
+	if (page) level->ranges.page = page;
+	if (!first || !num || !page) return -129;
+
+	level->sectors.cap = cap;
+	return 0;
+}
+
+// walls and their baked edges live in one allocation, right after the
+//	header; the vertices are allocated once there's a count of them
+static struct wall_store *allocWalls(uint32_t cap) {
+	struct wall_store *store = malloc(sizeof(struct wall_store)
+		+ (size_t) cap * (sizeof(struct wall) + 3 * sizeof(float) + sizeof(int32_t)
+			+ 2 * sizeof(uint32_t)));
+	if (!store) return NULL;
+
+	atomic_init(&store->refs, 1);
+	store->n = 0;
+	store->cap = cap;
+	store->walls = (struct wall *) (store + 1);
+	store->edges.nx = (float *) (store->walls + cap);
+	store->edges.ny = store->edges.nx + cap;
+	store->edges.len = store->edges.ny + cap;
+	store->edges.portal = (int32_t *) (store->edges.len + cap);
+	store->edges.va = (uint32_t *) (store->edges.portal + cap);
+	store->edges.vb = store->edges.va + cap;
+	store->verts.x = store->verts.y = NULL;
+	store->verts.n = store->verts.cap = 0;
+	store->verts.table = NULL;
+	store->mapping = NULL;
+	store->mappingSize = 0;
+	memset(&store->pages, 0, sizeof(store->pages));
+	return store;
+}
+
+static void releaseWalls(struct wall_store *store) {
+	if (store && atomic_fetch_sub(&store->refs, 1) == 1) {
+		if (store->mapping) munmap(store->mapping, store->mappingSize);
+		if (store->verts.cap) free(store->verts.x);
+		free(store->verts.table);
+		free(store->pages.resident);
+		free(store->pages.checked);
+		free(store);
+	}
+}
+
+// copy n walls (and their edges and vertex indices, but not the vertices) from
+//	src[si] to dst[di], the ranges may overlap
+static void moveWalls(struct wall_store *dst, uint32_t di,
+	const struct wall_store *src, uint32_t si, uint32_t n) {
+	memmove(&dst->walls[di], &src->walls[si], n * sizeof(struct wall));
+	memmove(&dst->edges.nx[di], &src->edges.nx[si], n * sizeof(float));
+	memmove(&dst->edges.ny[di], &src->edges.ny[si], n * sizeof(float));
+	memmove(&dst->edges.len[di], &src->edges.len[si], n * sizeof(float));
+	memmove(&dst->edges.portal[di], &src->edges.portal[si], n * sizeof(int32_t));
+	memmove(&dst->edges.va[di], &src->edges.va[si], n * sizeof(uint32_t));
+	memmove(&dst->edges.vb[di], &src->edges.vb[si], n * sizeof(uint32_t));
+}
+
+// where the last failed load on this thread went wrong, see levelErrorOffset()
+static _Thread_local long errorOffset = -1;
+
+long levelErrorOffset(void) {
+	return errorOffset;
+}
+
+void printLoadError(int status) {
+	const long offset = levelErrorOffset();
+	if (offset >= 0) {
+		fprintf(stderr, "Error loading level file: %d (at byte %ld)\n", status, offset);
+	} else {
+		fprintf(stderr, "Error loading level file: %d\n", status);
+	}
+}
+
+void printLoaded(const struct level *level) {
+	fprintf(stderr, "Loaded %zu sectors%s (%.1f MB in %.1f ms, %.0f MB/s)\n",
+		level->sectors.n - 1, level->load.cached ? " from the cache" : "",
+		level->load.bytes / 1e6, level->load.seconds * 1e3,
+		level->load.bytes / 1e6 / level->load.seconds);
+}
+
+// ids have to be checked against the number of sectors, which is only known
+//	once they've all been read, so sectors are kept in file order until then
+struct file_sectors {
+	struct {
+		struct sector *sector; // NULL if its id was wrong
+		size_t idAt;
+	} *arr;
+	size_t n, cap;
+	size_t total; // every sector in the file, including any not read
+};
+
+// make room for one more sector in file order, which starts out NULL
+static int pushFileSector(struct file_sectors *sectors, size_t idAt) {
+	if (sectors->n == sectors->cap) {
+		const size_t cap = sectors->cap ? sectors->cap * 2 : 256;
+		void *arr = realloc(sectors->arr, cap * sizeof(*sectors->arr));
+		if (!arr) return -129; // out of memory
+		sectors->arr = arr;
+		sectors->cap = cap;
+	}
+
+	sectors->arr[sectors->n].sector = NULL;
+	sectors->arr[sectors->n].idAt = idAt;
+	sectors->n++;
+	return 0;
+}
+
+// JSON levels are read in a single pass straight into the level rather than
+//	through a tree of the whole document: the schema is fixed, so the parser
+//	knows what every value it meets is for. it accepts exactly what cJSON
+//	(which levels used to be parsed with) did and gives the same errors, a
+//	syntax error anywhere (-4) over any problem with the contents, and
+//	otherwise the first problem in the file (which is the order the contents
+//	used to be checked in)
+#define JSON_NESTING_LIMIT 1000
+
+struct json_parser {
+	const char *start, *p, *end;
+	int depth;
+
+	bool syntax; // the document isn't JSON, p is where that became clear
+	int error; // first problem with the contents, 0 if none (yet)
+	size_t errorAt; // byte offset of the syntax error or of the problem
+};
+
+static bool syntaxError(struct json_parser *ps) {
+	ps->syntax = true;
+	ps->errorAt = ps->p - ps->start;
+	return false;
+}
+
+// note a problem with the contents at byte offset at, only the first one counts
+static void contentError(struct json_parser *ps, int error, size_t at) {
+	if (!ps->error || at < ps->errorAt) {
+		ps->error = error;
+		ps->errorAt = at;
+	}
+}
+
+// cJSON takes anything up to a space as whitespace
+static void skipSpace(struct json_parser *ps) {
+	while (ps->p < ps->end && (unsigned char) *ps->p <= ' ') ps->p++;
+}
+
+static bool isNumberStart(const struct json_parser *ps) {
+	return ps->p < ps->end && (*ps->p == '-' || (*ps->p >= '0' && *ps->p <= '9'));
+}
+
+static bool isNumberChar(char c) {
+	return (c >= '0' && c <= '9') || c == '+' || c == '-' || c == 'e' || c == 'E' || c == '.';
+}
+
+// a number is the longest run of the characters a number can have that
+//	strtod() takes a number from, in the C locale
+static bool parseNumber(struct json_parser *ps, double *out) {
+	// levels are mostly short integers, which strtod() would get exactly right
+	//	too but is slow at
+	const char *p = ps->p + (*ps->p == '-');
+	int64_t integer = 0;
+	int digits = 0;
+	while (p < ps->end && *p >= '0' && *p <= '9' && digits < 15) {
+		integer = integer * 10 + (*p++ - '0');
+		digits++;
+	}
+	if (digits > 0 && (p == ps->end || !isNumberChar(*p))) {
+		*out = *ps->p == '-' ? -(double) integer : (double) integer;
+		ps->p = p;
+		return true;
+	}
+
+	char number[64];
+	size_t n = 0;
+	while (n < sizeof(number) - 1 && ps->p + n < ps->end && isNumberChar(ps->p[n])) {
+		number[n] = ps->p[n];
+		n++;
+	}
+	number[n] = '\0';
+
+	char *after = NULL;
+	*out = strtod(number, &after);
+	if (after == number) return syntaxError(ps);
+
+	ps->p += after - number;
+	return true;
+}
+
+static int hexDigit(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+// four hex digits of a \u escape at p, -1 if they aren't
+static long parseHex(const struct json_parser *ps, const char *p) {
+	if (ps->end - p < 4) return -1;
+
+	long value = 0;
+	for (int i = 0; i < 4; i++) {
+		const int digit = hexDigit(p[i]);
+		if (digit < 0) return -1;
+		value = value * 16 + digit;
+	}
+	return value;
+}
+
+// parse a string, p is at the opening quote. if match isn't NULL, *matched
+//	says whether the string is equal to it (up to a \u0000, like strcmp() on
+//	what cJSON decoded)
+static bool parseString(struct json_parser *ps, const char *match, bool *matched) {
+	bool equal = match != NULL, ended = false;
+	const char *p = ps->p + 1;
+
+	for (;;) {
+		if (p >= ps->end) return syntaxError(ps);
+
+		long c = (unsigned char) *p++;
+		if (c == '"') break;
+
+		if (c == '\\') {
+			if (p >= ps->end) return syntaxError(ps);
+
+			switch (*p++) {
+			case 'b': c = '\b'; break;
+			case 'f': c = '\f'; break;
+			case 'n': c = '\n'; break;
+			case 'r': c = '\r'; break;
+			case 't': c = '\t'; break;
+			case '"': case '\\': case '/': c = p[-1]; break;
+			case 'u':
+				c = parseHex(ps, p);
+				p += 4;
+
+				// surrogates have to come in pairs, high then low
+				if (c >= 0xdc00 && c <= 0xdfff) c = -1;
+				else if (c >= 0xd800 && c <= 0xdbff) {
+					const long low = p + 1 < ps->end && p[0] == '\\' && p[1] == 'u'
+						? parseHex(ps, p + 2) : -1;
+					if (low < 0xdc00 || low > 0xdfff) c = -1;
+					p += 6;
+				}
+				if (c < 0) return syntaxError(ps);
+				break;
+			default:
+				return syntaxError(ps);
+			}
+		}
+
+		// anything that isn't ASCII can't be part of a match
+		if (match && !ended) {
+			if (c == 0) ended = true;
+			else if (c >= 0x80 || *match != c) equal = false;
+			else match++;
+		}
+	}
+
+	if (match) *matched = equal && !*match;
+	ps->p = p;
+	return true;
+}
+
+static bool skipValue(struct json_parser *ps);
+
+// start reading an array or an object, p is at the bracket; the values of an
+//	object are read in order like an array's, its keys are skipped
+static bool beginContainer(struct json_parser *ps, char *close) {
+	if (ps->depth >= JSON_NESTING_LIMIT) return syntaxError(ps);
+	ps->depth++;
+
+	*close = *ps->p++ == '[' ? ']' : '}';
+	return true;
+}
+
+// move to the next value in a container: true with p at the value, false at
+//	the end of the container or on a syntax error. index counts the values, the
+//	key of an object's value is compared to match if that isn't NULL
+static bool nextValue(struct json_parser *ps, char close, size_t *index,
+	const char *match, bool *matched) {
+	skipSpace(ps);
+	if (ps->p < ps->end && *ps->p == close) {
+		ps->p++;
+		ps->depth--;
+		return false;
+	}
+
+	if (*index > 0) {
+		if (ps->p >= ps->end || *ps->p != ',') return syntaxError(ps);
+		ps->p++;
+		skipSpace(ps);
+	}
+	++*index;
+
+	if (close == '}') {
+		if (ps->p >= ps->end || *ps->p != '"') return syntaxError(ps);
+		if (!parseString(ps, match, matched)) return false;
+
+		skipSpace(ps);
+		if (ps->p >= ps->end || *ps->p != ':') return syntaxError(ps);
+		ps->p++;
+		skipSpace(ps);
+	}
+	return true;
+}
+
+static bool isContainer(const struct json_parser *ps) {
+	return ps->p < ps->end && (*ps->p == '[' || *ps->p == '{');
+}
+
+// skip any value, p is at its first character
+static bool skipValue(struct json_parser *ps) {
+	if (ps->p >= ps->end) return syntaxError(ps);
+
+	if (isNumberStart(ps)) {
+		double ignored;
+		return parseNumber(ps, &ignored);
+	}
+
+	if (*ps->p == '"') return parseString(ps, NULL, NULL);
+
+	if (isContainer(ps)) {
+		char close;
+		size_t index = 0;
+		if (!beginContainer(ps, &close)) return false;
+
+		while (nextValue(ps, close, &index, NULL, NULL)) {
+			if (!skipValue(ps)) return false;
+		}
+		return !ps->syntax;
+	}
+
+	static const char *const literals[] = { "null", "false", "true" };
+	for (size_t i = 0; i < sizeof(literals) / sizeof(*literals); i++) {
+		const size_t n = strlen(literals[i]);
+		if ((size_t) (ps->end - ps->p) >= n && !memcmp(ps->p, literals[i], n)) {
+			ps->p += n;
+			return true;
+		}
+	}
+	return syntaxError(ps);
+}
+
+// a number where the schema wants one; anything else is skipped, false only
+//	on a syntax error
+static bool parseField(struct json_parser *ps, double *value, bool *isNumber) {
+	*isNumber = isNumberStart(ps);
+	return *isNumber ? parseNumber(ps, value) : skipValue(ps);
+}
+
+// add a wall to the end of the store, doubling it when it's full
+static int appendWall(struct level *level, struct wall wall) {
+	struct wall_store *store = level->walls;
+
+	if (store->n == store->cap) {
+		if (store->cap == UINT32_MAX) return -17; // too many walls
+
+		const uint32_t cap = store->cap < UINT32_MAX / 2 ? store->cap * 2 : UINT32_MAX;
+		struct wall_store *grown = allocWalls(cap);
+		if (!grown) return -129; // out of memory
+
+		memcpy(grown->walls, store->walls, store->n * sizeof(struct wall));
+		grown->n = store->n;
+		releaseWalls(store);
+		store = level->walls = grown;
+	}
+
+	store->walls[store->n++] = wall;
+	return 0;
+}
+
+// [x0, y0, x1, y1, portal]; a wall of the wrong size is an error (-11) even if
+//	its values are wrong too, so the whole wall is read before it's judged
+static int parseWall(struct json_parser *ps, struct level *level) {
+	const size_t at = ps->p - ps->start;
+
+	if (!isContainer(ps)) {
+		if (!skipValue(ps)) return 0;
+		contentError(ps, -11, at);
+		return 0;
+	}
+
+	int32_t values[5];
+	int error = 0;
+	size_t errorAt = 0;
+
+	char close;
+	size_t index = 0;
+	if (!beginContainer(ps, &close)) return 0;
+
+	while (nextValue(ps, close, &index, NULL, NULL)) {
+		const size_t valueAt = ps->p - ps->start;
+		if (index > 5) {
+			if (!skipValue(ps)) return 0;
+			continue;
+		}
+
+		double value = 0;
+		bool isNumber;
+		if (!parseField(ps, &value, &isNumber)) return 0;
+
+		if (!isNumber && !error) {
+			error = -12 - (int) (index - 1); // -12 for x0 to -16 for portal
+			errorAt = valueAt;
+		}
+		values[index - 1] = (int) value;
+	}
+	if (ps->syntax) return 0;
+
+	if (index != 5) contentError(ps, -11, at);
+	else if (error) contentError(ps, error, errorAt);
+	if (ps->error) return 0;
+
+	return appendWall(level, (struct wall) {
+		{ values[0], values[1] }, { values[2], values[3] }, values[4] });
+}
+
+// [id, zfloor, zceil, [walls...]]
+static int parseSector(struct json_parser *ps, struct level *level, struct file_sectors *sectors) {
+	if (!isContainer(ps)) {
+		const size_t at = ps->p - ps->start;
+		if (skipValue(ps)) contentError(ps, -7, at);
+		return 0;
+	}
+
+	char close;
+	size_t index = 0;
+	if (!beginContainer(ps, &close)) return 0;
+
+	struct sector *sector = NULL;
+	while (nextValue(ps, close, &index, NULL, NULL)) {
+		const size_t at = ps->p - ps->start;
+
+		// once there's a problem the rest of the file only has to be JSON
+		if (ps->error || index > 4) {
+			if (!skipValue(ps)) break;
+			continue;
+		}
+
+		if (index == 4) {
+			if (*ps->p != '[') {
+				if (skipValue(ps)) contentError(ps, -10, at);
+				continue;
+			}
+
+			sector->firstwall = level->walls->n;
+
+			char wallsClose;
+			size_t numwalls = 0;
+			if (!beginContainer(ps, &wallsClose)) break;
+
+			while (nextValue(ps, wallsClose, &numwalls, NULL, NULL)) {
+				if (ps->error) {
+					if (!skipValue(ps)) return 0;
+					continue;
+				}
+
+				const int retval = parseWall(ps, level);
+				if (retval) return retval;
+				if (ps->syntax) return 0;
+			}
+			if (ps->syntax) return 0;
+			sector->numwalls = level->walls->n - sector->firstwall;
+			continue;
+		}
+
+		double value;
+		bool isNumber;
+		if (!parseField(ps, &value, &isNumber)) break;
+		if (!isNumber) {
+			contentError(ps, -6 - (int) index, at); // -7 for the id to -9 for zceil
+			continue;
+		}
+
+		if (index == 1) {
+			const int id = (int) value;
+			if (id <= SECTOR_NONE) {
+				contentError(ps, -18, at);
+				continue;
+			}
+
+			sector = sectors->arr[sectors->n - 1].sector = allocSector(level->version);
+			if (!sector) return -129; // out of memory
+			sector->id = id;
+			sectors->arr[sectors->n - 1].idAt = at;
+		} else if (index == 2) {
+			sector->zfloor = (float) value;
+		} else {
+			sector->zceil = (float) value;
+		}
+	}
+	if (ps->syntax) return 0;
+
+	// missing values count as the wrong kind of value
+	if (index < 4) contentError(ps, -7 - (int) index, ps->p - 1 - ps->start);
+	return 0;
+}
+
+// {"sectors": [sectors...]}, anything else in the document is skipped
+static int parseLevel(struct json_parser *ps, struct level *level, struct file_sectors *sectors) {
+	// cJSON skips a byte order mark
+	if (ps->end - ps->p >= 3 && !memcmp(ps->p, "\xef\xbb\xbf", 3)) ps->p += 3;
+	skipSpace(ps);
+
+	if (ps->p >= ps->end || *ps->p != '{') {
+		if (skipValue(ps)) contentError(ps, -5, 0);
+		return 0;
+	}
+
+	char close;
+	size_t index = 0;
+	bool found = false, matched = false;
+	if (!beginContainer(ps, &close)) return 0;
+
+	while (nextValue(ps, close, &index, "sectors", &matched)) {
+		const size_t at = ps->p - ps->start;
+
+		// only the first "sectors" counts
+		if (!matched || found) {
+			if (!skipValue(ps)) return 0;
+			continue;
+		}
+		found = true;
+
+		if (*ps->p != '[') {
+			if (skipValue(ps)) contentError(ps, -5, at);
+			continue;
+		}
+
+		char sectorsClose;
+		if (!beginContainer(ps, &sectorsClose)) return 0;
+
+		while (nextValue(ps, sectorsClose, &sectors->total, NULL, NULL)) {
+			if (ps->error) {
+				if (!skipValue(ps)) return 0;
+				continue;
+			}
+
+			int retval = pushFileSector(sectors, ps->p - ps->start);
+			if (retval) return retval;
+			retval = parseSector(ps, level, sectors);
+			if (retval) return retval;
+			if (ps->syntax) return 0;
+		}
+		if (ps->syntax) return 0;
+	}
+	if (ps->syntax) return 0;
+
+	if (!found) contentError(ps, -5, ps->p - 1 - ps->start);
+	return 0;
+}
+
+// the JSON in buf (up to end) into sectors and the level's walls
+static int parseJSON(struct level *level, const char *buf, const char *end,
+	struct file_sectors *sectors) {
+	// a wall takes a couple dozen bytes of JSON, the store doubles if that's
+	//	an overestimate
+	level->walls = allocWalls((end - buf) / 32 + 16);
+	if (!level->walls) return -129; // out of memory
+
+	struct json_parser ps = { buf, buf, end, 0, false, 0, 0 };
+	const int retval = parseLevel(&ps, level, sectors);
+	if (retval) return retval;
+
+	if (ps.syntax) {
+		errorOffset = ps.errorAt;
+		return -4;
+	}
+
+	// ids go from 1 to the number of sectors; the first sector that's out of
+	//	range is the problem if it comes before any other
+	for (size_t i = 0; i < sectors->n; i++) {
+		if (sectors->arr[i].sector && (size_t) sectors->arr[i].sector->id > sectors->total) {
+			contentError(&ps, -18, sectors->arr[i].idAt);
+			break;
+		}
+	}
+
+	if (ps.error) {
+		errorOffset = ps.errorAt;
+		return ps.error;
+	}
+	return 0;
+}
+
+// the table format level.txt was written in: a [SECTOR] table with a row per
+//	sector (id, index of its first wall, number of walls, floor and ceiling)
+//	and a [WALL] table with a row per wall (x0, y0, x1, y1, portal), indexed
+//	from 0 in the order they're listed. # comments out the rest of a line.
+//	walls are stored in the order they're read, which is the order the
+//	sectors index them in, so there's nothing to rearrange
+struct table_parser {
+	const char *start, *p, *end;
+};
+
+static bool isDigit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+static bool isBlank(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// skip to the next field on a line, or to the end of the line
+static void skipBlanks(struct table_parser *tp) {
+	while (tp->p < tp->end && isBlank(*tp->p)) tp->p++;
+	if (tp->p < tp->end && *tp->p == '#') {
+		while (tp->p < tp->end && *tp->p != '\n') tp->p++;
+	}
+}
+
+static bool isLineEnd(const struct table_parser *tp, const char *p) {
+	return p == tp->end || *p == '\n' || *p == '#' || isBlank(*p);
+}
+
+// a table level starts with a table, after any comments; a JSON one can't
+static bool isTableLevel(const char *buf, const char *end) {
+	struct table_parser tp = { buf, buf, end };
+	if (end - buf >= 3 && !memcmp(buf, "\xef\xbb\xbf", 3)) tp.p += 3;
+
+	for (skipBlanks(&tp); tp.p < end && *tp.p == '\n'; skipBlanks(&tp)) tp.p++;
+	return (end - tp.p >= 8 && !memcmp(tp.p, "[SECTOR]", 8))
+		|| (end - tp.p >= 6 && !memcmp(tp.p, "[WALL]", 6));
+}
+
+static const double powersOf10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// a decimal number, [+-]digits[.digits][e[+-]digits], read without strtod()
+//	(which looks up the locale every time). the first 19 significant digits
+//	are kept; with up to 15 of them and a power of ten up to 1e22 the result
+//	is exact, which is every number a level has. otherwise it's within an ulp
+//	or so, the values end up as floats or ints anyway
+static bool parseDecimal(struct table_parser *tp, double *out) {
+	const char *p = tp->p;
+	const bool negative = p < tp->end && *p == '-';
+	if (p < tp->end && (*p == '-' || *p == '+')) p++;
+
+	uint64_t mantissa = 0;
+	int digits = 0, exponent = 0;
+	bool any = false;
+	for (; p < tp->end && isDigit(*p); p++) {
+		if (digits < 19) {
+			mantissa = mantissa * 10 + (*p - '0');
+			digits += mantissa != 0;
+		} else {
+			exponent++;
+		}
+		any = true;
+	}
+	if (p < tp->end && *p == '.') {
+		for (p++; p < tp->end && isDigit(*p); p++) {
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				digits += mantissa != 0;
+				exponent--;
+			}
+			any = true;
+		}
+	}
+	if (!any) return false;
+
+	if (p < tp->end && (*p == 'e' || *p == 'E')) {
+		p++;
+		const bool negativeExponent = p < tp->end && *p == '-';
+		if (p < tp->end && (*p == '-' || *p == '+')) p++;
+		if (p == tp->end || !isDigit(*p)) return false;
+
+		int n = 0;
+		for (; p < tp->end && isDigit(*p); p++) {
+			if (n < 100000) n = n * 10 + (*p - '0');
+		}
+		exponent += negativeExponent ? -n : n;
+	}
+	if (!isLineEnd(tp, p)) return false;
+
+	double value = (double) mantissa;
+	if (mantissa != 0) {
+		for (; exponent > 22; exponent -= 22) value *= 1e22;
+		for (; exponent < -22; exponent += 22) value /= 1e22;
+		value = exponent < 0 ? value / powersOf10[-exponent] : value * powersOf10[exponent];
+	}
+
+	*out = negative ? -value : value;
+	tp->p = p;
+	return true;
+}
+
+// read a row of 5 numbers, returns 5 if that's what it is, otherwise the
+//	index of the first one that's missing or isn't a number, or 6 if there's
+//	more. at is set to the byte offset of each field, and of what's after them
+static int parseRow(struct table_parser *tp, double values[5], size_t at[6]) {
+	for (int i = 0; i < 5; i++) {
+		skipBlanks(tp);
+		at[i] = tp->p - tp->start;
+		if (tp->p == tp->end || *tp->p == '\n' || !parseDecimal(tp, &values[i])) return i;
+	}
+
+	skipBlanks(tp);
+	at[5] = tp->p - tp->start;
+	return tp->p == tp->end || *tp->p == '\n' ? 5 : 6;
+}
+
+static bool isInteger(double value, double min, double max) {
+	if (!(value >= min && value <= max)) return false;
+	const double fraction = value - (double) (int64_t) value;
+	return !(fraction < 0 || fraction > 0);
+}
+
+static int parseSectorRow(struct table_parser *tp, struct level *level,
+	struct file_sectors *sectors) {
+	// by field: id, first wall, number of walls, floor, ceiling
+	static const int errors[] = { -7, -10, -10, -8, -9 };
+
+	double values[5];
+	size_t at[6];
+	const int n = parseRow(tp, values, at);
+	if (n != 5) {
+		errorOffset = at[n < 5 ? n : 5];
+		return n < 5 ? errors[n] : -4; // a value that's missing, wrong or extra
+	}
+
+	if (!isInteger(values[0], 1, INT32_MAX)) {
+		errorOffset = at[0];
+		return -18; // bad id
+	}
+	for (int i = 1; i <= 2; i++) {
+		if (!isInteger(values[i], 0, UINT32_MAX)) {
+			errorOffset = at[i];
+			return -10; // not a range of walls
+		}
+	}
+
+	int retval = pushFileSector(sectors, at[0]);
+	if (retval) return retval;
+
+	struct sector *sector = sectors->arr[sectors->n - 1].sector = allocSector(level->version);
+	if (!sector) return -129; // out of memory
+
+	sector->id = (int) values[0];
+	sector->firstwall = (uint32_t) values[1];
+	sector->numwalls = (uint32_t) values[2];
+	sector->zfloor = (float) values[3];
+	sector->zceil = (float) values[4];
+	return 0;
+}
+
+static int parseWallRow(struct table_parser *tp, struct level *level) {
+	double values[5];
+	size_t at[6];
+	const int n = parseRow(tp, values, at);
+	if (n != 5) {
+		errorOffset = at[n < 5 ? n : 5];
+		// a value that isn't a number, or the wrong number of them
+		return n < 5 && !isLineEnd(tp, tp->p) ? -12 - n : -11;
+	}
+
+	for (int i = 0; i < 5; i++) {
+		if (!isInteger(values[i], INT32_MIN, INT32_MAX)) {
+			errorOffset = at[i];
+			return -12 - i; // -12 for x0 to -16 for portal
+		}
+	}
+
+	return appendWall(level, (struct wall) {
+		{ (int32_t) values[0], (int32_t) values[1] },
+		{ (int32_t) values[2], (int32_t) values[3] }, (int32_t) values[4] });
+}
+
+static int compareRanges(const void *a, const void *b) {
+	const struct sector *const *p = a, *const *q = b;
+	if ((*p)->firstwall != (*q)->firstwall) return (*p)->firstwall < (*q)->firstwall ? -1 : 1;
+	return 0;
+}
+
+// every sector's walls have to be in the table and no two sectors can share
+//	any, since a sector's walls are edited in place
+static int checkRanges(const struct level *level, struct file_sectors *sectors) {
+	for (size_t i = 0; i < sectors->n; i++) {
+		const struct sector *sector = sectors->arr[i].sector;
+		if ((size_t) sector->id > sectors->n) {
+			errorOffset = sectors->arr[i].idAt;
+			return -18; // bad id
+		}
+		if ((uint64_t) sector->firstwall + sector->numwalls > level->walls->n) {
+			errorOffset = sectors->arr[i].idAt;
+			return -10; // walls past the end of the table
+		}
+	}
+
+	struct sector **sorted = malloc((sectors->n + 1) * sizeof(struct sector *));
+	if (!sorted) return -129; // out of memory
+
+	size_t n = 0;
+	for (size_t i = 0; i < sectors->n; i++) {
+		if (sectors->arr[i].sector->numwalls) sorted[n++] = sectors->arr[i].sector;
+	}
+	qsort(sorted, n, sizeof(struct sector *), compareRanges);
+
+	int retval = 0;
+	for (size_t i = 1; i < n && !retval; i++) {
+		if (sorted[i - 1]->firstwall + sorted[i - 1]->numwalls > sorted[i]->firstwall) {
+			for (size_t j = 0; j < sectors->n; j++) {
+				if (sectors->arr[j].sector == sorted[i]) errorOffset = sectors->arr[j].idAt;
+			}
+			retval = -10; // walls shared with another sector
+		}
+	}
+
+	free(sorted);
+	return retval;
+}
+
+// the tables in buf (up to end) into sectors and the level's walls
+static int parseTables(struct level *level, const char *buf, const char *end,
+	struct file_sectors *sectors) {
+	// a row of a few small numbers takes a dozen bytes or so
+	level->walls = allocWalls((end - buf) / 16 + 16);
+	if (!level->walls) return -129; // out of memory
+
+	struct table_parser tp = { buf, buf, end };
+	if (end - buf >= 3 && !memcmp(buf, "\xef\xbb\xbf", 3)) tp.p += 3;
+
+	enum { TABLE_NONE, TABLE_SECTOR, TABLE_WALL } table = TABLE_NONE;
+	bool found = false;
+	for (skipBlanks(&tp); tp.p < end; skipBlanks(&tp)) {
+		if (*tp.p == '\n') {
+			tp.p++;
+			continue;
+		}
+
+		int retval = 0;
+		if (*tp.p == '[') {
+			const char *start = tp.p;
+			if (end - tp.p >= 8 && !memcmp(tp.p, "[SECTOR]", 8)) {
+				table = TABLE_SECTOR;
+				found = true;
+				tp.p += 8;
+			} else if (end - tp.p >= 6 && !memcmp(tp.p, "[WALL]", 6)) {
+				table = TABLE_WALL;
+				tp.p += 6;
+			}
+
+			skipBlanks(&tp);
+			if (tp.p == start || (tp.p < end && *tp.p != '\n')) {
+				errorOffset = tp.p - buf;
+				return -4; // not a table this format has
+			}
+		} else if (table == TABLE_SECTOR) {
+			retval = parseSectorRow(&tp, level, sectors);
+		} else if (table == TABLE_WALL) {
+			retval = parseWallRow(&tp, level);
+		} else {
+			retval = -4; // a row that isn't in a table
+			errorOffset = tp.p - buf;
+		}
+		if (retval) return retval;
+	}
+
+	if (!found) {
+		errorOffset = tp.p - buf;
+		return -5; // no sectors
+	}
+
+	sectors->total = sectors->n;
+	return checkRanges(level, sectors);
+}
+
+// read a whole text level file into a null-terminated buffer the caller frees
+static int readText(const char *path, char **out, size_t *length) {
+	FILE *f = fopen(path, "rb");
+	if (!f) return -1; // file not found (or couldn't be opened)
+
+	char *buf = NULL;
+	int retval = 0;
+	fseek(f, 0L, SEEK_END); // seek to the end of the file
+	long size = ftell(f); // get position, equivalent to the size of the file
+	rewind(f); // go back to the beginning of the file
+
+	if (size == -1) { retval = -2; goto done; } // error reading file size
+
+	// the whole file is read at once into a buffer sized to fit it
+	buf = malloc((size_t) size + 1);
+	if (!buf) { retval = -129; goto done; } // out of memory
+
+	size_t newLen = fread(buf, sizeof(char), size, f);
+	buf[newLen] = '\0'; // guarantee that it's null-terminated
+
+	if (ferror(f)) { retval = -128; goto done; }
+
+	*out = buf;
+	*length = newLen;
+	buf = NULL;
+
+done:
+	fclose(f);
+	free(buf);
+	return retval;
+}
+
+// load sectors and walls from the text of a JSON or table file, told apart
+//	by its contents
+static int loadSectors(struct level *level, const char *buf) {
+	level->sectors.n = 1; // there's no sector 0
+
+	int retval = 0;
+	struct file_sectors sectors = { 0 };
+
+	// like cJSON, stop at a null byte
+	const char *end = buf + strlen(buf);
+	retval = isTableLevel(buf, end)
+		? parseTables(level, buf, end, &sectors)
+		: parseJSON(level, buf, end, &sectors);
+	if (retval) goto done;
+
+	if ((retval = reserveSectors(level, sectors.total + 1))) goto done;
+
+	// a repeated id replaces the sector before it, validateLevel() then finds
+	//	the id that's missing
+	for (size_t i = 0; i < sectors.n; i++) {
+		struct sector *sector = sectors.arr[i].sector;
+		releaseSector(level->sectors.arr[sector->id]);
+		level->sectors.arr[sector->id] = sector;
+		sectors.arr[i].sector = NULL;
+	}
+	level->sectors.n += sectors.total;
+
+done:
+	// sectors that didn't make it into the level
+	for (size_t i = 0; i < sectors.n; i++) releaseSector(sectors.arr[i].sector);
+	free(sectors.arr);
+	return retval;
+}
+
+// make sure the level is safe to hand to the renderer: every sector id up to
+//	the highest one has to be defined and portals must point at one of them.
+//	a paged level's walls are checked a page at a time instead, as they're
+//	paged in (see checkPage())
+static int validateLevel(const struct level *level) {
+	const bool paged = level->walls->pages.n != 0;
+	for (size_t i = 1; i < level->sectors.n; i++) {
+		const struct sector *sector = level->sectors.arr[i];
+
+		if (!sector || sector->id != (int) i) {
+			return -19; // sector ids aren't contiguous
+		}
+		if (paged) continue;
+
+		const struct wall *walls = sectorWalls(level, sector);
+		for (size_t j = 0; j < sector->numwalls; j++) {
+			const int portal = walls[j].portal;
+
+			if (portal < 0 || (size_t) portal >= level->sectors.n) {
+				return -20; // portal to a sector that doesn't exist
+			}
+		}
+	}
+	return 0;
+}
+
+static struct level *allocLevel(void) {
+	struct level *level = calloc(1, sizeof(struct level));
+	if (!level) return NULL;
+
+	atomic_init(&level->refs, 1);
+	level->version = atomic_fetch_add(&nextVersion, 1);
+	return level;
+}
+
+// binary levels: a header followed by the sector and wall tables and, if the
+//	level was baked, the rest of the wall store's arrays, each section 64 byte
+//	aligned. everything is little endian and laid out the way it is in memory,
+//	so the file can be mapped and used as it is
+#define LEVEL_MAGIC "RCLV"
+#define LEVEL_FORMAT_VERSION 5
+#define LEVEL_SECTION_ALIGN 64
+
+// walls are written in pages of sectors near each other with up to this many
+//	walls (unless one sector has more), big enough that each of the per-wall
+//	arrays has a few system pages of every page
+#define LEVEL_PAGE_WALLS 4096
+
+enum level_section {
+	SECTION_SECTORS, SECTION_WALLS,
+	SECTION_NX, SECTION_NY, SECTION_LEN, SECTION_PORTAL,
+	SECTION_VA, SECTION_VB, SECTION_VX, SECTION_VY,
+	SECTION_PAGES,
+	SECTIONS
+};
+
+struct level_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t numsectors; // including sector 0
+	uint32_t numwalls, numverts;
+	uint32_t baked; // 1 if the sections from SECTION_NX on are there
+	uint32_t numpages, reserved; // reserved is 0
+	uint64_t sourcesize, sourcehash; // text a cached level was parsed from, 0 if it isn't one
+	uint64_t offsets[SECTIONS]; // from the start of the file
+};
+
+// the text a level was parsed from, by its size and hash
+struct level_source { uint64_t size, hash; };
+
+static int writeBinary(const struct level *level, const char *path,
+	const struct level_source *source);
+
+struct level_file_sector {
+	int32_t id;
+	uint32_t firstwall, numwalls;
+	float zfloor, zceil;
+	float bounds[4]; // min x, y and max x, y; only set if the level is baked
+};
+
+_Static_assert(sizeof(struct level_header) == 136, "level header has padding");
+_Static_assert(sizeof(struct level_file_sector) == 36, "level sector has padding");
+_Static_assert(sizeof(struct wall) == 20, "wall has padding");
+
+static bool isLittleEndian(void) {
+	return __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+}
+
+// size of one element of a section
+static size_t sectionElement(enum level_section section) {
+	switch (section) {
+	case SECTION_SECTORS: return sizeof(struct level_file_sector);
+	case SECTION_WALLS: return sizeof(struct wall);
+	default: return 4; // floats and 32-bit ints
+	}
+}
+
+// number of elements in a section
+static uint64_t sectionCount(const struct level_header *header, enum level_section section) {
+	switch (section) {
+	case SECTION_SECTORS: return header->numsectors;
+	case SECTION_VX: case SECTION_VY: return header->numverts;
+	case SECTION_PAGES: return header->numpages;
+	default: return header->numwalls;
+	}
+}
+
+// lay out the sections one after the other, aligned, returns the file size
+static uint64_t layoutSections(struct level_header *header) {
+	uint64_t offset = sizeof(struct level_header);
+	const int sections = header->baked ? SECTIONS : SECTION_NX;
+
+	for (int i = 0; i < SECTIONS; i++) {
+		offset = (offset + LEVEL_SECTION_ALIGN - 1) & ~(uint64_t) (LEVEL_SECTION_ALIGN - 1);
+		header->offsets[i] = i < sections ? offset : 0;
+		if (i < sections) offset += sectionCount(header, i) * sectionElement(i);
+	}
+	return offset;
+}
+
+static bool isBinaryLevel(const char *path) {
+	char magic[4] = { 0 };
+	FILE *f = fopen(path, "rb");
+	if (!f) return false;
+
+	const bool binary = fread(magic, 1, sizeof(magic), f) == sizeof(magic)
+		&& !memcmp(magic, LEVEL_MAGIC, sizeof(magic));
+	fclose(f);
+	return binary;
+}
+
+// map a binary level and use its walls in place; only the sectors are copied
+//	out, since they're refcounted. baked is set if the file has everything
+//	the renderer needs, otherwise the level still has to be baked
+static int loadBinary(struct level *level, const char *path, bool *baked) {
+	if (!isLittleEndian()) return -21; // files are little endian
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return -1; // file not found (or couldn't be opened)
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return -2; // error reading file size
+	}
+
+	const size_t size = st.st_size;
+	if (size < sizeof(struct level_header)) {
+		close(fd);
+		return -22; // truncated
+	}
+
+	// private and writable: edits made in place (see editWalls()) never reach the file
+	void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) return -128;
+
+	struct wall_store *store = calloc(1, sizeof(struct wall_store));
+	if (!store) {
+		munmap(base, size);
+		return -129; // out of memory
+	}
+
+	// from here on the mapping is released with the level, even on errors
+	atomic_init(&store->refs, 1);
+	store->mapping = base;
+	store->mappingSize = size;
+	level->walls = store;
+	level->load.bytes = size;
+
+	const struct level_header *header = base;
+	if (memcmp(header->magic, LEVEL_MAGIC, sizeof(header->magic))
+		|| header->version != LEVEL_FORMAT_VERSION) {
+		return -21; // not a binary level this version can read
+	}
+
+	// every section has to be aligned and inside the file
+	const int sections = header->baked ? SECTIONS : SECTION_NX;
+	for (int i = 0; i < sections; i++) {
+		const uint64_t offset = header->offsets[i];
+		if (offset % LEVEL_SECTION_ALIGN || offset > size
+			|| sectionCount(header, i) > (size - offset) / sectionElement(i)) {
+			return -22;
+		}
+	}
+
+	uint8_t *bytes = base;
+	const struct level_file_sector *sectors =
+		(const struct level_file_sector *) &bytes[header->offsets[SECTION_SECTORS]];
+	struct wall *walls = (struct wall *) &bytes[header->offsets[SECTION_WALLS]];
+
+	const uint32_t numwalls = header->numwalls;
+	store->n = store->cap = numwalls;
+	store->walls = walls;
+
+	if (header->baked) {
+		if (header->numverts > INT32_MAX) return -22;
+
+		store->edges.nx = (float *) &bytes[header->offsets[SECTION_NX]];
+		store->edges.ny = (float *) &bytes[header->offsets[SECTION_NY]];
+		store->edges.len = (float *) &bytes[header->offsets[SECTION_LEN]];
+		store->edges.portal = (int32_t *) &bytes[header->offsets[SECTION_PORTAL]];
+		store->edges.va = (uint32_t *) &bytes[header->offsets[SECTION_VA]];
+		store->edges.vb = (uint32_t *) &bytes[header->offsets[SECTION_VB]];
+		store->verts.x = (float *) &bytes[header->offsets[SECTION_VX]];
+		store->verts.y = (float *) &bytes[header->offsets[SECTION_VY]];
+		store->verts.n = header->numverts;
+
+		// every wall is on a page. pages have to start at increasing walls, the
+		//	first one at the first wall
+		const uint32_t *first = (const uint32_t *) &bytes[header->offsets[SECTION_PAGES]];
+		if (numwalls && !header->numpages) return -22;
+		for (uint32_t i = 0; i < header->numpages; i++) {
+			if (first[i] >= numwalls || (i == 0 ? first[i] != 0 : first[i] <= first[i - 1])) {
+				return -22;
+			}
+		}
+
+		// the renderer trusts the walls' vertices and portals, but they're
+		//	only checked as their pages are paged in: checking them here would
+		//	read the whole file
+		if (header->numpages) {
+			store->pages.resident = calloc(header->numpages, sizeof(bool));
+			store->pages.checked = calloc(header->numpages, sizeof(int8_t));
+			if (!store->pages.resident || !store->pages.checked) return -129;
+			store->pages.first = first;
+			store->pages.n = header->numpages;
+		}
+	} else {
+		// nothing to use in place but the walls, so copy them into a store
+		//	with room for the baked data and let the mapping go
+		struct wall_store *copy = allocWalls(numwalls);
+		if (!copy) return -129;
+
+		memcpy(copy->walls, walls, numwalls * sizeof(struct wall));
+		copy->n = numwalls;
+		level->walls = copy;
+		releaseWalls(store);
+	}
+
+	if (header->numsectors == 0) return -19; // there has to be a sector 0
+
+	int retval = reserveSectors(level, header->numsectors);
+	if (retval != 0) return retval;
+
+	for (uint32_t i = 0; i < header->numsectors; i++) {
+		const struct level_file_sector *fs = &sectors[i];
+
+		if (fs->numwalls > numwalls || fs->firstwall > numwalls - fs->numwalls) {
+			return -22; // walls outside of the wall table
+		}
+
+		struct sector *sector = level->sectors.arr[i] = allocSector(level->version);
+		if (!sector) return -129;
+
+		sector->id = fs->id;
+		sector->firstwall = fs->firstwall;
+		sector->numwalls = fs->numwalls;
+		sector->zfloor = fs->zfloor;
+		sector->zceil = fs->zceil;
+		sector->bounds.min = (vect2) { fs->bounds[0], fs->bounds[1] };
+		sector->bounds.max = (vect2) { fs->bounds[2], fs->bounds[3] };
+		level->sectors.n++;
+	}
+
+	*baked = header->baked;
+	return 0;
+}
+
+// bytes of the mapped per-wall arrays each wall takes
+#define PAGED_WALL_BYTES (sizeof(struct wall) + 3 * sizeof(float) + 3 * sizeof(int32_t))
+
+static uint32_t pageWalls(const struct wall_store *store, uint32_t page) {
+	const uint32_t end = page + 1 < store->pages.n ? store->pages.first[page + 1] : store->n;
+	return end - store->pages.first[page];
+}
+
+// tell the system about walls [first, first + n) of every mapped per-wall
+//	array: MADV_WILLNEED takes in every system page they're on, MADV_DONTNEED
+//	only the ones that hold nothing but those walls
+static void adviseWalls(const struct wall_store *store, uint32_t first, uint32_t n, int advice) {
+	const uintptr_t size = sysconf(_SC_PAGESIZE);
+	const struct { const void *arr; size_t element; } arrays[] = {
+		{ store->walls, sizeof(struct wall) },
+		{ store->edges.nx, sizeof(float) }, { store->edges.ny, sizeof(float) },
+		{ store->edges.len, sizeof(float) },
+		{ store->edges.portal, sizeof(int32_t) },
+		{ store->edges.va, sizeof(uint32_t) }, { store->edges.vb, sizeof(uint32_t) }
+	};
+
+	for (size_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++) {
+		uintptr_t start = (uintptr_t) arrays[i].arr + first * arrays[i].element;
+		uintptr_t end = start + n * arrays[i].element;
+		if (advice == MADV_DONTNEED) {
+			start = (start + size - 1) & ~(size - 1);
+			end &= ~(size - 1);
+		} else {
+			start &= ~(size - 1);
+			end = (end + size - 1) & ~(size - 1);
+		}
+		if (start < end) madvise((void *) start, end - start, advice);
+	}
+}
+
+// whether walls [first, first + n) of a baked store can be used: their
+//	vertices have to exist, and their portals lead to sectors that do.
+//	0, -20 or -22
+static int checkWalls(const struct wall_store *store, uint32_t first, uint32_t n, size_t numsectors) {
+	for (uint32_t i = first; i < first + n; i++) {
+		if (store->edges.va[i] >= store->verts.n || store->edges.vb[i] >= store->verts.n) {
+			return -22;
+		}
+
+		const int32_t portal = store->edges.portal[i];
+		if (portal < 0 || (size_t) portal >= numsectors || store->walls[i].portal != portal) {
+			return -20; // portal to a sector that doesn't exist
+		}
+	}
+	return 0;
+}
+
+// check a page's walls the first time they're going to be used, and keep
+//	what came of it; 0 or their error
+static int checkPage(const struct level *level, uint32_t page) {
+	struct wall_store *store = level->walls;
+	if (!store->pages.checked[page]) {
+		const int retval = checkWalls(store, store->pages.first[page],
+			pageWalls(store, page), level->sectors.n);
+		store->pages.checked[page] = retval != 0 ? retval : 1;
+	}
+	return store->pages.checked[page] < 0 ? store->pages.checked[page] : 0;
+}
+
+int checkLevel(const struct level *level) {
+	struct wall_store *store = level->walls;
+	for (uint32_t page = 0; page < store->pages.n; page++) {
+		const int retval = checkPage(level, page);
+		if (retval != 0) return retval;
+		store->pages.resident[page] = true;
+	}
+	return 0;
+}
+
+// stop paging a version's store that's about to be written to: a page the
+//	system was given back would be read from the file again, without the
+//	changes. every wall is used from then on, so they're all checked first;
+//	0 or the error they have
+static int unpageWalls(const struct level *level) {
+	const int retval = checkLevel(level);
+	if (retval == 0) level->walls->pages.n = 0;
+	return retval;
+}
+
+void pageLevel(const struct level *level, size_t id, size_t budget) {
+	struct wall_store *store = level->walls;
+	if (store->pages.n == 0 || id >= level->sectors.n || level->ranges.num[id] == 0) return;
+	if (store->pages.version == level->version && store->pages.sector == id
+		&& store->pages.budget == budget) {
+		return;
+	}
+
+	bool *wanted = calloc(store->pages.n, sizeof(bool));
+	bool *seen = calloc(level->sectors.n, sizeof(bool));
+	uint32_t *queue = malloc(level->sectors.n * sizeof(uint32_t));
+	if (!wanted || !seen || !queue) goto done; // the pages stay as they are
+
+	// breadth first through the portals, so pages are taken nearest first;
+	//	sectors on a page that doesn't fit aren't gone through
+	size_t used = 0, head = 0, tail = 0;
+	queue[tail++] = id;
+	seen[id] = true;
+	while (head < tail) {
+		const uint32_t i = queue[head++];
+		const uint32_t page = level->ranges.page[i];
+
+		if (level->ranges.num[i] == 0) continue;
+		if (!wanted[page]) {
+			if (checkPage(level, page) != 0) continue; // bad walls are never paged in
+			const size_t bytes = pageWalls(store, page) * PAGED_WALL_BYTES;
+			if (i != id && used + bytes > budget) continue;
+			wanted[page] = true;
+			used += bytes;
+		}
+
+		const int32_t *portals = &store->edges.portal[level->ranges.first[i]];
+		for (uint32_t j = 0; j < level->ranges.num[i]; j++) {
+			if (portals[j] != SECTOR_NONE && !seen[portals[j]]) {
+				seen[portals[j]] = true;
+				queue[tail++] = portals[j];
+			}
+		}
+	}
+
+	for (uint32_t page = 0; page < store->pages.n; page++) {
+		if (wanted[page] == store->pages.resident[page]) continue;
+
+		adviseWalls(store, store->pages.first[page], pageWalls(store, page),
+			wanted[page] ? MADV_WILLNEED : MADV_DONTNEED);
+		store->pages.resident[page] = wanted[page];
+	}
+
+	store->pages.version = level->version;
+	store->pages.sector = id;
+	store->pages.budget = budget;
+
+done:
+	free(wanted);
+	free(seen);
+	free(queue);
+}
+
+// whether p is inside the sector with this id, on the inside of all its walls
+static bool insideSector(const struct level *level, uint32_t id, vect2 p) {
+	const struct wall_store *store = level->walls;
+	const uint32_t first = level->ranges.first[id];
+	for (uint32_t i = first; i < first + level->ranges.num[id]; i++) {
+		const uint32_t a = store->edges.va[i];
+		if ((p.x - store->verts.x[a]) * store->edges.nx[i]
+			+ (p.y - store->verts.y[a]) * store->edges.ny[i] < 0.0f) {
+			return false;
+		}
+	}
+	return level->ranges.num[id] != 0;
+}
+
+// the sector p is in, looked up in the grid; SECTOR_NONE if it's in none
+static int findRaySector(const struct level *level, vect2 p) {
+	size_t n;
+	const uint32_t *ids = sectorsNear(level, p, &n);
+	for (size_t i = 0; i < n; i++) {
+		if (sectorResident(level, ids[i]) && insideSector(level, ids[i], p)) return ids[i];
+	}
+	return SECTOR_NONE;
+}
+
+bool castRay(const struct level *level, const struct ray *ray, struct ray_hit *hit) {
+	*hit = (struct ray_hit) { SECTOR_NONE, UINT32_MAX, 0.0f };
+
+	int id = ray->sector == SECTOR_NONE ? findRaySector(level, ray->origin) : ray->sector;
+	if (id <= SECTOR_NONE || (size_t) id >= level->sectors.n) return false;
+	hit->sector = id;
+	if (!sectorResident(level, id)) return false;
+
+	const float length = sqrtf(ray->dir.x * ray->dir.x + ray->dir.y * ray->dir.y);
+	if (!(length > 0.0f)) return false;
+	const vect2 o = ray->origin, d = { ray->dir.x / length, ray->dir.y / length };
+
+	const struct wall_store *store = level->walls;
+	const float *vx = store->verts.x, *vy = store->verts.y;
+	const float *nx = store->edges.nx, *ny = store->edges.ny;
+	const uint32_t *va = store->edges.va;
+
+	// every portal leads into another sector, a ray can't go through more
+	//	portals than there are sectors without going round in circles
+	float t = 0.0f;
+	for (size_t steps = 0; steps < level->sectors.n; steps++) {
+		hit->sector = id;
+
+		// sectors are convex, so the ray leaves through the nearest of the
+		//	walls it's heading out through (the inward normal against it)
+		const uint32_t first = level->ranges.first[id];
+		uint32_t exit = UINT32_MAX;
+		float nearest = INFINITY;
+		for (uint32_t i = first; i < first + level->ranges.num[id]; i++) {
+			const float dn = d.x * nx[i] + d.y * ny[i];
+			if (!(dn < 0.0f)) continue;
+
+			const float at = ((o.x - vx[va[i]]) * nx[i] + (o.y - vy[va[i]]) * ny[i]) / -dn;
+			if (at < nearest) {
+				nearest = at;
+				exit = i;
+			}
+		}
+		if (exit == UINT32_MAX) break;
+
+		// going through a corner can leave the next sector's exit a hair
+		//	behind the last one, the ray doesn't go back for it
+		t = fmaxf(t, nearest);
+		if (t > ray->maxDist) {
+			hit->distance = ray->maxDist;
+			return false;
+		}
+
+		const int32_t portal = store->edges.portal[exit];
+		if (portal == SECTOR_NONE || (size_t) portal >= level->sectors.n
+			|| !sectorResident(level, portal)) {
+			hit->wall = exit - first;
+			hit->distance = t;
+			return true;
+		}
+		id = portal;
+	}
+
+	hit->distance = t;
+	return false;
+}
+
+void pointsInSector(const struct level *level, const struct sector *sector,
+	const float *px, const float *py, size_t n, bool *inside) {
+	const uint32_t i = sector->firstwall;
+	const struct wall_store *store = level->walls;
+	pointsInEdges(store->verts.x, store->verts.y, &store->edges.va[i], &store->edges.vb[i],
+		sector->numwalls, px, py, n, inside);
+}
+
+struct ray_key { uint32_t sector; size_t index; };
+
+static int compareRayKeys(const void *a, const void *b) {
+	const struct ray_key *p = a, *q = b;
+	if (p->sector != q->sector) return p->sector < q->sector ? -1 : 1;
+	return p->index < q->index ? -1 : p->index > q->index;
+}
+
+int castRays(const struct level *level, const struct ray *rays, struct ray_hit *hits, size_t n) {
+	if (n == 0) return 0;
+
+	struct ray_key *order = malloc(n * sizeof(struct ray_key));
+	if (!order) return -129; // out of memory
+
+	// rays from the same sector one after the other, so they go through the
+	//	same walls while those are still in the cache
+	for (size_t i = 0; i < n; i++) {
+		const int id = rays[i].sector == SECTOR_NONE
+			? findRaySector(level, rays[i].origin) : rays[i].sector;
+		order[i] = (struct ray_key) { (uint32_t) id, i };
+	}
+	qsort(order, n, sizeof(struct ray_key), compareRayKeys);
+
+	for (size_t i = 0; i < n; i++) {
+		struct ray ray = rays[order[i].index];
+		if (order[i].sector == SECTOR_NONE) {
+			hits[order[i].index] = (struct ray_hit) { SECTOR_NONE, UINT32_MAX, 0.0f };
+			continue;
+		}
+		ray.sector = (int) order[i].sector;
+		castRay(level, &ray, &hits[order[i].index]);
+	}
+
+	free(order);
+	return 0;
+}
+
+static float dot(vect2 a, vect2 b) {
+	return a.x * b.x + a.y * b.y;
+}
+
+// whether something standing in sector from fits through a portal to sector
+//	to: it can't step up too high or squeeze under too low a ceiling, and the
+//	sector has to be in memory
+static bool canPass(const struct level *level, int from, int to) {
+	if (!sectorResident(level, to)) return false;
+
+	const struct sector *a = level->sectors.arr[from], *b = level->sectors.arr[to];
+	return b->zfloor - a->zfloor <= STEP_HEIGHT
+		&& fminf(a->zceil, b->zceil) - fmaxf(a->zfloor, b->zfloor) >= PLAYER_HEIGHT;
+}
+
+// add the walls of sector id that can't be gone through from it, apart from
+//	the portal back to sector from; 0 or -129 if out of memory
+static int addBlockers(const struct level *level, int id, int from, struct blocker_list *list) {
+	const uint32_t first = level->ranges.first[id];
+	const struct wall_store *store = level->walls;
+
+	for (size_t i = first; i < first + level->ranges.num[id]; i++) {
+		const int portal = store->edges.portal[i];
+		if (portal != SECTOR_NONE && (portal == from || canPass(level, id, portal))) continue;
+
+		if (list->n == list->cap) {
+			const size_t cap = list->cap ? 2 * list->cap : 256;
+			struct blocker *arr = realloc(list->arr, cap * sizeof(struct blocker));
+			if (!arr) return -129;
+
+			list->arr = arr;
+			list->cap = cap;
+		}
+		list->arr[list->n++] = (struct blocker) {
+			{ store->verts.x[store->edges.va[i]], store->verts.y[store->edges.va[i]] },
+			{ store->verts.x[store->edges.vb[i]], store->verts.y[store->edges.vb[i]] },
+			{ store->edges.nx[i], store->edges.ny[i] },
+			store->edges.len[i]
+		};
+	}
+	return 0;
+}
+
+// when a circle of radius r moving from p by v first touches the wall w, as
+//	a fraction of the move, and the direction it's pushed back in there; false
+//	if it doesn't during the move (or is moving away from it)
+static bool sweepCircle(vect2 p, vect2 v, float r, const struct blocker *w, float *t, vect2 *normal) {
+	const vect2 a = w->a, b = w->b, ab = { b.x - a.x, b.y - a.y };
+	const float len2 = w->len * w->len;
+	bool hit = false;
+
+	// the side of the wall's line the circle is on
+	if (w->len > 0.0f) {
+		vect2 n = w->normal;
+		float d = (p.x - a.x) * n.x + (p.y - a.y) * n.y;
+		if (d < 0.0f) {
+			n = (vect2) { -n.x, -n.y };
+			d = -d;
+		}
+
+		// moving towards it, and close enough to get within r during the move
+		//	(or already there)
+		const float vn = dot(v, n);
+		if (vn < 0.0f && d - r <= -vn) {
+			const float tl = fmaxf((d - r) / -vn, 0.0f);
+			const vect2 c = { p.x + v.x * tl - a.x, p.y + v.y * tl - a.y };
+			const float s = dot(c, ab);
+			if (s >= 0.0f && s <= len2) {
+				*t = tl;
+				*normal = n;
+				return true;
+			}
+		}
+	}
+
+	// otherwise it can only touch one of the ends
+	const vect2 ends[2] = { a, b };
+	for (int i = 0; i < 2; i++) {
+		const vect2 m = { p.x - ends[i].x, p.y - ends[i].y };
+		const float
+			qb = dot(m, v),
+			qc = dot(m, m) - r * r,
+			qa = dot(v, v);
+		if (qb >= 0.0f || qa <= 0.0f) continue; // moving away from it
+
+		float te = 0.0f;
+		if (qc > 0.0f) {
+			const float disc = qb * qb - qa * qc;
+			if (disc < 0.0f) continue;
+			te = (-qb - sqrtf(disc)) / qa;
+		}
+		if (te > 1.0f || (hit && te >= *t)) continue;
+
+		const vect2 c = { m.x + v.x * te, m.y + v.y * te };
+		const float len = sqrtf(dot(c, c));
+		*t = te;
+		*normal = len > 0.0f ? (vect2) { c.x / len, c.y / len } : (vect2) { -v.x, -v.y };
+		hit = true;
+	}
+	return hit;
+}
+
+vect2 collideMove(const struct level *level, int id, vect2 p, vect2 v, float r,
+	struct blocker_list *list) {
+	if (id == SECTOR_NONE || (size_t) id >= level->sectors.n || !sectorResident(level, id)) {
+		return (vect2) { p.x + v.x, p.y + v.y };
+	}
+
+	// every wall that could be in the way has to be tested, or the move
+	//	could go through the ones left out; without the memory for them it
+	//	doesn't go anywhere
+	list->n = 0;
+	if (addBlockers(level, id, SECTOR_NONE, list) != 0) return p;
+
+	const int32_t *portals = &level->walls->edges.portal[level->ranges.first[id]];
+	for (size_t i = 0; i < level->ranges.num[id]; i++) {
+		if (portals[i] != SECTOR_NONE && canPass(level, id, portals[i])
+			&& addBlockers(level, portals[i], id, list) != 0) {
+			return p;
+		}
+	}
+	const struct blocker *blockers = list->arr;
+	const size_t n = list->n;
+
+	// move up to the first wall in the way and slide along it, a few times
+	//	over for corners; whatever's left after that is dropped
+	for (int round = 0; round < 3; round++) {
+		float first = 1.0f;
+		vect2 normal = { 0.0f, 0.0f };
+		bool hit = false;
+		for (size_t i = 0; i < n; i++) {
+			float t = 1.0f;
+			vect2 nt = { 0.0f, 0.0f };
+			if (sweepCircle(p, v, r, &blockers[i], &t, &nt) && t < first) {
+				first = t;
+				normal = nt;
+				hit = true;
+			}
+		}
+
+		p.x += v.x * first;
+		p.y += v.y * first;
+		if (!hit) break;
+
+		// keep what's left of the move along the wall
+		v = (vect2) { v.x * (1.0f - first), v.y * (1.0f - first) };
+		const float into = dot(v, normal);
+		v.x -= normal.x * into;
+		v.y -= normal.y * into;
+	}
+	return p;
+}
+
+static int loadText(struct level *level, const char *buf) {
+	// sector 0 (SECTOR_NONE) always exists but has no walls
+	int retval = reserveSectors(level, 1);
+	if (retval == 0 && !(level->sectors.arr[SECTOR_NONE] = allocSector(level->version))) {
+		retval = -129;
+	}
+
+	if (retval == 0) retval = loadSectors(level, buf);
+	return retval;
+}
+
+// the page a wall is in, 0 if the store isn't paged
+static uint32_t wallPage(const struct wall_store *store, uint32_t wall) {
+	uint32_t lo = 0, hi = store->pages.n; // the last page that starts at or before wall
+	while (hi - lo > 1) {
+		const uint32_t mid = lo + (hi - lo) / 2;
+		if (store->pages.first[mid] <= wall) lo = mid;
+		else hi = mid;
+	}
+	return lo;
+}
+
+// sectors without walls aren't in the grid, and neither are ones whose
+//	bounds aren't numbers (as a file can have them)
+static bool inGrid(const struct sector *sector) {
+	const vect2 min = sector->bounds.min, max = sector->bounds.max;
+	return sector->numwalls && isfinite(min.x) && isfinite(min.y)
+		&& isfinite(max.x) && isfinite(max.y);
+}
+
+// the cells of the grid a sector's bounds cover, false if it isn't in it
+struct grid_rect { uint32_t x0, y0, x1, y1; };
+
+static bool sectorCells(const struct level *level, const struct sector *sector,
+	struct grid_rect *rect) {
+	if (!inGrid(sector)) return false;
+
+	const vect2 min = sector->bounds.min, max = sector->bounds.max;
+	*rect = (struct grid_rect) {
+		gridCell(min.x, level->grid.min.x, level->grid.scale, level->grid.w),
+		gridCell(min.y, level->grid.min.y, level->grid.scale, level->grid.h),
+		gridCell(max.x, level->grid.min.x, level->grid.scale, level->grid.w),
+		gridCell(max.y, level->grid.min.y, level->grid.scale, level->grid.h)
+	};
+	return true;
+}
+
+static bool inRect(const struct grid_rect *rect, uint32_t x, uint32_t y) {
+	return rect && x >= rect->x0 && x <= rect->x1 && y >= rect->y0 && y <= rect->y1;
+}
+
+static struct grid_tile *allocTile(size_t n) {
+	struct grid_tile *tile = malloc(sizeof(struct grid_tile) + n * sizeof(uint32_t));
+	if (tile) atomic_init(&tile->refs, 1);
+	return tile;
+}
+
+static void releaseTile(struct grid_tile *tile) {
+	if (tile && atomic_fetch_sub(&tile->refs, 1) == 1) free(tile);
+}
+
+static void freeGrid(struct level *level) {
+	for (size_t t = 0; level->grid.tiles && t < (size_t) level->grid.tw * level->grid.th; t++) {
+		releaseTile(level->grid.tiles[t]);
+	}
+	free(level->grid.tiles);
+	memset(&level->grid, 0, sizeof(level->grid));
+}
+
+// index the sectors by their bounds in a grid with about as many cells as
+//	there are sectors; without one (if there's no memory for it) every lookup
+//	comes up empty and the player's sector is found by going through portals
+static void bakeGrid(struct level *level) {
+	freeGrid(level);
+
+	size_t n = 0;
+	vect2 min = { INFINITY, INFINITY }, max = { -INFINITY, -INFINITY };
+	for (size_t i = 0; i < level->sectors.n; i++) {
+		const struct sector *sector = level->sectors.arr[i];
+		if (!inGrid(sector)) continue;
+		min.x = fminf(min.x, sector->bounds.min.x); min.y = fminf(min.y, sector->bounds.min.y);
+		max.x = fmaxf(max.x, sector->bounds.max.x); max.y = fmaxf(max.y, sector->bounds.max.y);
+		n++;
+	}
+	if (n == 0) return;
+
+	// square cells, each about the size of an average sector
+	const float width = max.x - min.x, height = max.y - min.y;
+	float side = sqrtf(width * height / n);
+	if (!(side > 0.0f)) side = fmaxf(fmaxf(width, height) / n, 1.0f);
+
+	const uint32_t
+		w = (uint32_t) fminf(width / side + 1.0f, 4096.0f),
+		h = (uint32_t) fminf(height / side + 1.0f, 4096.0f),
+		tw = (w + GRID_TILE - 1) / GRID_TILE,
+		th = (h + GRID_TILE - 1) / GRID_TILE;
+
+	// the number of sectors in each cell, then where in its tile each cell
+	//	is filled from next
+	uint32_t *cells = calloc((size_t) w * h, sizeof(uint32_t));
+	struct grid_tile **tiles = calloc((size_t) tw * th, sizeof(struct grid_tile *));
+	if (!cells || !tiles) {
+		free(cells);
+		free(tiles);
+		return;
+	}
+
+	level->grid.min = min;
+	level->grid.max = max;
+	level->grid.scale = 1.0f / side;
+	level->grid.w = w;
+	level->grid.h = h;
+	level->grid.tw = tw;
+	level->grid.th = th;
+	level->grid.tiles = tiles;
+	level->grid.built = level->sectors.n;
+	for (size_t i = 0; i < level->sectors.n; i++) {
+		struct grid_rect r;
+		if (!sectorCells(level, level->sectors.arr[i], &r)) continue;
+		for (uint32_t y = r.y0; y <= r.y1; y++) {
+			for (uint32_t x = r.x0; x <= r.x1; x++) cells[y * w + x]++;
+		}
+	}
+
+	for (uint32_t t = 0; t < tw * th; t++) {
+		const uint32_t tx = t % tw * GRID_TILE, ty = t / tw * GRID_TILE;
+		uint32_t start[GRID_TILE * GRID_TILE + 1];
+		start[0] = 0;
+		for (uint32_t c = 0; c < GRID_TILE * GRID_TILE; c++) {
+			const uint32_t x = tx + c % GRID_TILE, y = ty + c / GRID_TILE;
+			uint32_t count = 0;
+			if (x < w && y < h) {
+				count = cells[y * w + x];
+				cells[y * w + x] = start[c];
+			}
+			start[c + 1] = start[c] + count;
+		}
+
+		if (!(tiles[t] = allocTile(start[GRID_TILE * GRID_TILE]))) {
+			free(cells);
+			freeGrid(level);
+			return;
+		}
+		memcpy(tiles[t]->start, start, sizeof(start));
+	}
+
+	// in order of id, like an edit keeps them
+	for (size_t i = 0; i < level->sectors.n; i++) {
+		struct grid_rect r;
+		if (!sectorCells(level, level->sectors.arr[i], &r)) continue;
+		for (uint32_t y = r.y0; y <= r.y1; y++) {
+			for (uint32_t x = r.x0; x <= r.x1; x++) {
+				struct grid_tile *tile = tiles[(y / GRID_TILE) * tw + x / GRID_TILE];
+				tile->ids[cells[y * w + x]++] = i;
+			}
+		}
+	}
+	free(cells);
+}
+
+// replace tile t of an unpublished version's grid with a copy where sector
+//	id is out of the cells of from and in the cells of to (either can be
+//	NULL); false if out of memory
+static bool moveInTile(struct level *level, uint32_t t, uint32_t id,
+	const struct grid_rect *from, const struct grid_rect *to) {
+	const struct grid_tile *tile = level->grid.tiles[t];
+	const uint32_t tx = t % level->grid.tw * GRID_TILE, ty = t / level->grid.tw * GRID_TILE;
+
+	struct grid_tile *copy = allocTile(tile->start[GRID_TILE * GRID_TILE] + GRID_TILE * GRID_TILE);
+	if (!copy) return false;
+
+	uint32_t n = 0;
+	for (uint32_t c = 0; c < GRID_TILE * GRID_TILE; c++) {
+		const uint32_t x = tx + c % GRID_TILE, y = ty + c / GRID_TILE;
+		const bool out = inRect(from, x, y), in = inRect(to, x, y);
+
+		// the id is taken out of the cell and put back in its place in order
+		bool put = !in;
+		copy->start[c] = n;
+		for (uint32_t j = tile->start[c]; j < tile->start[c + 1]; j++) {
+			const uint32_t other = tile->ids[j];
+			if (other == id && (out || in)) continue;
+			if (!put && other > id) {
+				copy->ids[n++] = id;
+				put = true;
+			}
+			copy->ids[n++] = other;
+		}
+		if (!put) copy->ids[n++] = id;
+	}
+	copy->start[GRID_TILE * GRID_TILE] = n;
+
+	releaseTile(level->grid.tiles[t]);
+	level->grid.tiles[t] = copy;
+	return true;
+}
+
+// move sector id in an unpublished version's grid from the cells of the
+//	bounds it was put in the grid with (from, NULL if it wasn't) to those of
+//	the sector it is now (to, NULL if it's gone); only the tiles either
+//	covers are copied. false if out of memory
+static bool moveInGrid(struct level *level, uint32_t id,
+	const struct sector *from, const struct sector *to) {
+	struct grid_rect a, b;
+	if (level->grid.w == 0) return true;
+
+	const struct grid_rect *rects[2] = {
+		from && sectorCells(level, from, &a) ? &a : NULL,
+		to && sectorCells(level, to, &b) ? &b : NULL
+	};
+
+	for (int k = 0; k < 2; k++) {
+		const struct grid_rect *r = rects[k];
+		if (!r) continue;
+
+		for (uint32_t ty = r->y0 / GRID_TILE; ty <= r->y1 / GRID_TILE; ty++) {
+			for (uint32_t tx = r->x0 / GRID_TILE; tx <= r->x1 / GRID_TILE; tx++) {
+				// a tile both cover is only copied once
+				const struct grid_rect *o = rects[0];
+				if (k == 1 && o && tx >= o->x0 / GRID_TILE && tx <= o->x1 / GRID_TILE
+					&& ty >= o->y0 / GRID_TILE && ty <= o->y1 / GRID_TILE) {
+					continue;
+				}
+				if (!moveInTile(level, ty * level->grid.tw + tx, id, rects[0], rects[1])) return false;
+			}
+		}
+	}
+	return true;
+}
+
+// recompute the per-sector data that only depends on the sectors (not their
+//	walls): the renderer's wall ranges, and the grid if there isn't one yet
+static void bakeRanges(struct level *level) {
+	level->maxwalls = 0;
+	for (size_t i = 0; i < level->sectors.n; i++) {
+		level->ranges.first[i] = level->sectors.arr[i]->firstwall;
+		level->ranges.num[i] = level->sectors.arr[i]->numwalls;
+		level->ranges.page[i] = wallPage(level->walls, level->ranges.first[i]);
+		if (level->ranges.num[i] > level->maxwalls) level->maxwalls = level->ranges.num[i];
+	}
+
+	if (level->grid.w == 0) bakeGrid(level);
+}
+
+static double seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t rotl64(uint64_t v, int r) {
+	return (v << r) | (v >> (64 - r));
+}
+
+// 64-bit hash of a level's text, 8 bytes at a time (MurmurHash3's mixing)
+static uint64_t hashText(const char *buf, size_t size) {
+	uint64_t h = 0x9E3779B97F4A7C15u ^ size;
+	for (size_t i = 0; i < size; i += 8) {
+		uint64_t k = 0;
+		memcpy(&k, &buf[i], size - i < 8 ? size - i : 8);
+
+		k *= 0x87C37B91114253D5u;
+		k = rotl64(k, 31);
+		k *= 0x4CF5AD432745937Fu;
+		h ^= k;
+		h = rotl64(h, 27) * 5 + 0x52DCE729;
+	}
+
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDu;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53u;
+	h ^= h >> 33;
+	return h;
+}
+
+// where a level parsed from this text is in the cache, false if there's no
+//	cache. named after the text's hash and size and the format version, so
+//	that different text (or an older format) is mostly never even opened
+static bool cachePath(const struct level_source *source, char *path, size_t n) {
+	const char *dir = getenv(LEVEL_CACHE_ENV);
+	if (!dir || !*dir) return false;
+
+	const int len = snprintf(path, n, "%s/%016" PRIx64 "-%" PRIu64 ".v%d.bin",
+		dir, source->hash, source->size, LEVEL_FORMAT_VERSION);
+	return len > 0 && (size_t) len < n;
+}
+
+// a baked level from the cache, NULL if it isn't there or can't be used (it's
+//	replaced once the level's been parsed again). the hash isn't
+//	cryptographic, so the file has to say it was parsed from the same text
+//	too, or two texts whose hashes collide would share an entry
+static struct level *loadCached(const char *path, const struct level_source *source) {
+	struct level *level = allocLevel();
+	if (!level) return NULL;
+
+	bool baked = false;
+	const struct level_header *header = NULL;
+	if (loadBinary(level, path, &baked) == 0) header = level->walls->mapping;
+	if (!header || !baked || header->sourcesize != source->size
+		|| header->sourcehash != source->hash || validateLevel(level) != 0) {
+		releaseLevel(level);
+		return NULL;
+	}
+
+	bakeRanges(level);
+	level->load.cached = true;
+	return level;
+}
+
+// put a level into the cache; the cache is only ever a shortcut, so nothing
+//	that goes wrong here is an error
+static void saveCached(const struct level *level, const char *path,
+	const struct level_source *source) {
+	char dir[PATH_MAX];
+	snprintf(dir, sizeof(dir), "%s", path);
+	char *slash = strrchr(dir, '/');
+	if (slash && slash != dir) {
+		*slash = '\0';
+		mkdir(dir, 0777);
+	}
+
+	writeBinary(level, path, source);
+}
+
+int loadLevel(const char *path, struct level **out) {
+	const double start = seconds();
+	errorOffset = -1;
+
+	struct level *level = allocLevel();
+	if (!level) return -129; // out of memory
+
+	bool baked = false, cache = false;
+	char cached[PATH_MAX];
+	struct level_source source = { 0, 0 };
+	int retval;
+	if (isBinaryLevel(path)) {
+		retval = loadBinary(level, path, &baked);
+	} else {
+		// text is looked up in the cache by its hash, and only parsed if it
+		//	isn't there
+		char *buf = NULL;
+		size_t size = 0;
+		retval = readText(path, &buf, &size);
+
+		struct level *hit = NULL;
+		if (retval == 0) source = (struct level_source) { size, hashText(buf, size) };
+		if (retval == 0 && (cache = cachePath(&source, cached, sizeof(cached)))) {
+			hit = loadCached(cached, &source);
+		}
+
+		if (hit) {
+			releaseLevel(level);
+			level = hit;
+			cache = false;
+		} else if (retval == 0) {
+			retval = loadText(level, buf);
+		}
+		level->load.bytes = size;
+		free(buf);
+	}
+
+	// one from the cache has been validated and baked already
+	if (retval == 0 && !level->load.cached) {
+		retval = validateLevel(level);
+
+		// a baked binary level is used as it is, baking would touch every page
+		//	of it (and its walls are checked as they're paged in)
+		if (retval == 0 && baked) bakeRanges(level);
+		else if (retval == 0) retval = bakeLevel(level);
+	}
+
+	if (retval != 0) {
+		releaseLevel(level);
+		return retval;
+	}
+
+	if (cache) saveCached(level, cached, &source);
+
+	level->load.seconds = seconds() - start;
+	*out = level;
+	return 0;
+}
+
+// levels are written next to the file they replace and renamed over it once
+//	they're complete, so that a failed save leaves the old file alone and a
+//	level that's mapped from the old file keeps it until it's released
+static FILE *openTemp(const char *path, char **tmp) {
+	// named after the process and the save, so that two saving the same file
+	//	(as processes sharing a level cache do) each write a file of their own
+	static atomic_uint saves;
+	const int n = snprintf(NULL, 0, "%s.%ld.%u.tmp", path, (long) getpid(), UINT_MAX);
+	*tmp = malloc(n + 1);
+	if (!*tmp) return NULL;
+
+	sprintf(*tmp, "%s.%ld.%u.tmp", path, (long) getpid(), atomic_fetch_add(&saves, 1));
+	FILE *f = fopen(*tmp, "wbx");
+	if (!f) {
+		free(*tmp);
+		*tmp = NULL;
+	}
+	return f;
+}
+
+// close the temporary file and, if everything was written, put it in place;
+//	returns 0 or -128 on an I/O error
+static int closeTemp(FILE *f, char *tmp, const char *path, bool ok) {
+	if (fclose(f) != 0) ok = false;
+	if (ok && rename(tmp, path) != 0) ok = false;
+	if (!ok) remove(tmp);
+
+	free(tmp);
+	return ok ? 0 : -128;
+}
+
+// write n bytes, false if that didn't work
+static bool writeBytes(FILE *f, const void *p, size_t n) {
+	return fwrite(p, 1, n, f) == n;
+}
+
+// pad the file with zeroes up to offset
+static bool writePadding(FILE *f, uint64_t offset) {
+	static const uint8_t zeroes[LEVEL_SECTION_ALIGN];
+	const long at = ftell(f);
+	return at >= 0 && (uint64_t) at <= offset
+		&& writeBytes(f, zeroes, offset - at);
+}
+
+// the bits of a 16-bit number spread out to every other bit
+static uint32_t spreadBits(uint32_t v) {
+	v &= 0xFFFF;
+	v = (v | (v << 8)) & 0x00FF00FF;
+	v = (v | (v << 4)) & 0x0F0F0F0F;
+	v = (v | (v << 2)) & 0x33333333;
+	v = (v | (v << 1)) & 0x55555555;
+	return v;
+}
+
+struct sector_key { uint32_t key, id; };
+
+static int compareKeys(const void *a, const void *b) {
+	const struct sector_key *p = a, *q = b;
+	if (p->key != q->key) return p->key < q->key ? -1 : 1;
+	return p->id < q->id ? -1 : p->id > q->id;
+}
+
+// the order sectors' walls are written in: by the centres of the sectors'
+//	bounds along a Z-order curve, so that sectors near each other end up in
+//	the same page. NULL if out of memory
+static struct sector_key *orderSectors(const struct level *level) {
+	struct sector_key *order = malloc(level->sectors.n * sizeof(struct sector_key));
+	if (!order) return NULL;
+
+	vect2 min = { INFINITY, INFINITY }, max = { -INFINITY, -INFINITY };
+	for (size_t i = 0; i < level->sectors.n; i++) {
+		const struct sector *sector = level->sectors.arr[i];
+		if (!sector->numwalls) continue;
+		min.x = fminf(min.x, sector->bounds.min.x); min.y = fminf(min.y, sector->bounds.min.y);
+		max.x = fmaxf(max.x, sector->bounds.max.x); max.y = fmaxf(max.y, sector->bounds.max.y);
+	}
+	const float
+		sx = max.x > min.x ? 65535.0f / (max.x - min.x) : 0.0f,
+		sy = max.y > min.y ? 65535.0f / (max.y - min.y) : 0.0f;
+
+	for (size_t i = 0; i < level->sectors.n; i++) {
+		const struct sector *sector = level->sectors.arr[i];
+		const float
+			x = (sector->bounds.min.x + sector->bounds.max.x) * 0.5f,
+			y = (sector->bounds.min.y + sector->bounds.max.y) * 0.5f;
+
+		order[i].id = i;
+		order[i].key = !sector->numwalls ? 0
+			: spreadBits((uint32_t) ((x - min.x) * sx)) | spreadBits((uint32_t) ((y - min.y) * sy)) << 1;
+	}
+	qsort(order, level->sectors.n, sizeof(struct sector_key), compareKeys);
+	return order;
+}
+
+int saveLevelBinary(const struct level *level, const char *path) {
+	const struct level_source none = { 0, 0 };
+	return writeBinary(level, path, &none);
+}
+
+static int writeBinary(const struct level *level, const char *path,
+	const struct level_source *source) {
+	if (!isLittleEndian()) return -21;
+
+	const struct wall_store *store = level->walls;
+
+	// only the walls in use are written, a page of sectors after the other;
+	//	each sector's place in the file, and each page's first wall
+	struct sector_key *order = orderSectors(level);
+	uint32_t *firstwall = malloc(level->sectors.n * sizeof(uint32_t));
+	uint32_t *pages = malloc(level->sectors.n * sizeof(uint32_t));
+	if (!order || !firstwall || !pages) {
+		free(order); free(firstwall); free(pages);
+		return -129; // out of memory
+	}
+
+	struct level_header header = {
+		.version = LEVEL_FORMAT_VERSION,
+		.numsectors = level->sectors.n,
+		.numverts = store->verts.n,
+		.baked = 1,
+		.sourcesize = source->size,
+		.sourcehash = source->hash
+	};
+	for (size_t i = 0, page = 0; i < level->sectors.n; i++) {
+		const struct sector *sector = level->sectors.arr[order[i].id];
+		if (sector->numwalls && (!header.numpages
+			|| header.numwalls - page + sector->numwalls > LEVEL_PAGE_WALLS)) {
+			page = pages[header.numpages++] = header.numwalls;
+		}
+
+		firstwall[order[i].id] = header.numwalls;
+		header.numwalls += sector->numwalls;
+	}
+	memcpy(header.magic, LEVEL_MAGIC, sizeof(header.magic));
+	layoutSections(&header);
+
+	char *tmp;
+	FILE *f = openTemp(path, &tmp);
+	if (!f) {
+		free(order); free(firstwall); free(pages);
+		return -1;
+	}
+
+	bool ok = writeBytes(f, &header, sizeof(header));
+
+	ok = ok && writePadding(f, header.offsets[SECTION_SECTORS]);
+	for (size_t i = 0; ok && i < level->sectors.n; i++) {
+		const struct sector *sector = level->sectors.arr[i];
+		const struct level_file_sector fs = {
+			.id = sector->id,
+			.firstwall = firstwall[i],
+			.numwalls = sector->numwalls,
+			.zfloor = sector->zfloor,
+			.zceil = sector->zceil,
+			.bounds = {
+				sector->bounds.min.x, sector->bounds.min.y,
+				sector->bounds.max.x, sector->bounds.max.y
+			}
+		};
+		ok = writeBytes(f, &fs, sizeof(fs));
+	}
+
+	// every per-wall array, each with the sectors' ranges in the same order
+	const void *arrays[] = {
+		[SECTION_WALLS] = store->walls,
+		[SECTION_NX] = store->edges.nx, [SECTION_NY] = store->edges.ny,
+		[SECTION_LEN] = store->edges.len,
+		[SECTION_PORTAL] = store->edges.portal,
+		[SECTION_VA] = store->edges.va, [SECTION_VB] = store->edges.vb
+	};
+	for (int s = SECTION_WALLS; ok && s <= SECTION_VB; s++) {
+		const size_t element = sectionElement(s);
+		ok = writePadding(f, header.offsets[s]);
+
+		for (size_t i = 0; ok && i < level->sectors.n; i++) {
+			const struct sector *sector = level->sectors.arr[order[i].id];
+			ok = writeBytes(f, (const uint8_t *) arrays[s] + sector->firstwall * element,
+				sector->numwalls * element);
+		}
+	}
+
+	// the vertices only ever include the walls in use already
+	ok = ok && writePadding(f, header.offsets[SECTION_VX])
+		&& writeBytes(f, store->verts.x, store->verts.n * sizeof(float))
+		&& writePadding(f, header.offsets[SECTION_VY])
+		&& writeBytes(f, store->verts.y, store->verts.n * sizeof(float))
+		&& writePadding(f, header.offsets[SECTION_PAGES])
+		&& writeBytes(f, pages, header.numpages * sizeof(uint32_t));
+
+	free(order);
+	free(firstwall);
+	free(pages);
+	return closeTemp(f, tmp, path, ok);
+}
+
+// write an integer in decimal, returns its length (at most 11)
+static size_t formatInt(char *buf, int32_t v) {
+	char digits[10];
+	size_t n = 0, len = 0;
+	uint32_t u = v < 0 ? 0u - (uint32_t) v : (uint32_t) v;
+
+	do {
+		digits[n++] = '0' + u % 10;
+		u /= 10;
+	} while (u);
+
+	if (v < 0) buf[len++] = '-';
+	while (n) buf[len++] = digits[--n];
+	return len;
+}
+
+// shortest way to write a float that reads back as the same float, returns
+//	its length
+static size_t formatFloat(char *buf, size_t size, float v) {
+	// heights are usually whole numbers, which are written like walls' numbers
+	if (fabsf(v) < 1e7f) {
+		const int32_t whole = (int32_t) v;
+		const float back = (float) whole;
+		if (!memcmp(&back, &v, sizeof(float))) return formatInt(buf, whole);
+	}
+
+	for (int precision = 1; precision < 9; precision++) {
+		snprintf(buf, size, "%.*g", precision, v);
+		const float back = strtof(buf, NULL);
+		if (!memcmp(&back, &v, sizeof(float))) return strlen(buf);
+	}
+	return snprintf(buf, size, "%.9g", v);
+}
+
+// JSON is put together in memory in one go, measured by a first pass that
+//	only counts (out is NULL) and then written by a second into a buffer of
+//	exactly that size. floats are only formatted by the first pass, which
+//	keeps their text (each after a length byte) for the second to copy
+struct json_writer {
+	char *out;
+	size_t size;
+	struct {
+		char *text;
+		size_t n, cap, at;
+		bool failed; // out of memory
+	} floats;
+};
+
+static void put(struct json_writer *w, const char *s, size_t n) {
+	if (w->out) memcpy(w->out + w->size, s, n);
+	w->size += n;
+}
+
+#define PUT(w, s) put(w, s, sizeof(s) - 1)
+
+static void putInt(struct json_writer *w, int32_t v) {
+	char buf[12];
+	put(w, buf, formatInt(buf, v));
+}
+
+static void putFloat(struct json_writer *w, float v) {
+	if (w->out) {
+		const size_t len = (unsigned char) w->floats.text[w->floats.at];
+		put(w, &w->floats.text[w->floats.at + 1], len);
+		w->floats.at += 1 + len;
+		return;
+	}
+
+	char buf[32];
+	const size_t len = formatFloat(buf, sizeof(buf), v);
+	put(w, buf, len);
+	if (w->floats.failed) return;
+
+	if (w->floats.n + 1 + len > w->floats.cap) {
+		const size_t cap = w->floats.cap ? 2 * w->floats.cap : 4096;
+		char *text = realloc(w->floats.text, cap);
+		if (!text) {
+			w->floats.failed = true;
+			return;
+		}
+		w->floats.text = text;
+		w->floats.cap = cap;
+	}
+	w->floats.text[w->floats.n] = (char) len;
+	memcpy(&w->floats.text[w->floats.n + 1], buf, len);
+	w->floats.n += 1 + len;
+}
+
+// the same layout as level.json
+static void writeJSON(struct json_writer *w, const struct level *level) {
+	PUT(w, "{\n\t\"sectors\": [");
+
+	// sector 0 isn't in the file
+	for (size_t i = 1; i < level->sectors.n; i++) {
+		const struct sector *sector = level->sectors.arr[i];
+		const struct wall *walls = sectorWalls(level, sector);
+
+		if (i > 1) PUT(w, ",");
+		PUT(w, "\n\t\t[");
+		putInt(w, sector->id);
+		PUT(w, ", ");
+		putFloat(w, sector->zfloor);
+		PUT(w, ", ");
+		putFloat(w, sector->zceil);
+		PUT(w, ", [");
+
+		for (size_t j = 0; j < sector->numwalls; j++) {
+			const struct wall *wall = &walls[j];
+
+			if (j > 0) PUT(w, ",");
+			PUT(w, "\n\t\t\t[");
+			putInt(w, wall->a.x);
+			PUT(w, ", ");
+			putInt(w, wall->a.y);
+			PUT(w, ", ");
+			putInt(w, wall->b.x);
+			PUT(w, ", ");
+			putInt(w, wall->b.y);
+			PUT(w, ", ");
+			putInt(w, wall->portal);
+			PUT(w, "]");
+		}
+		if (sector->numwalls > 0) PUT(w, "\n\t\t");
+		PUT(w, "]]");
+	}
+
+	PUT(w, "\n\t]\n}\n");
+}
+
+int saveLevelJSON(const struct level *level, const char *path) {
+	// JSON has no way to write NaN or infinity
+	for (size_t i = 1; i < level->sectors.n; i++) {
+		if (!isfinite(level->sectors.arr[i]->zfloor)) return -8;
+		if (!isfinite(level->sectors.arr[i]->zceil)) return -9;
+	}
+
+	struct json_writer w = { 0 };
+	writeJSON(&w, level);
+	if (w.floats.failed) {
+		free(w.floats.text);
+		return -129; // out of memory
+	}
+
+	w.out = malloc(w.size);
+	if (!w.out) {
+		free(w.floats.text);
+		return -129; // out of memory
+	}
+	const size_t size = w.size;
+	w.size = 0;
+	writeJSON(&w, level);
+	free(w.floats.text);
+
+	char *tmp;
+	FILE *f = openTemp(path, &tmp);
+	if (!f) {
+		free(w.out);
+		return -1;
+	}
+
+	const bool ok = writeBytes(f, w.out, size);
+	free(w.out);
+	return closeTemp(f, tmp, path, ok);
+}
+
+int saveLevel(const struct level *level, const char *path) {
+	const char *extension = strrchr(path, '.');
+	return extension && !strcmp(extension, ".json")
+		? saveLevelJSON(level, path) : saveLevelBinary(level, path);
+}
+
+// open addressed hash table of a store's vertices by position
+struct vert_table {
+	size_t size; // a power of two
+	struct { vect2i p; uint32_t v; } slots[]; // v is the vertex index + 1, 0 if unused
+};
+
+static struct vert_table *allocVertTable(size_t size) {
+	struct vert_table *table = calloc(1, sizeof(struct vert_table) + size * sizeof(table->slots[0]));
+	if (table) table->size = size;
+	return table;
+}
+
+// make room for n vertices in a store, with some to spare if it's growing
+//	rather than being rebuilt (exact); the ones it has are kept, and copied
+//	out of the file if that's where they are. 0, -17 if there'd be too many
+//	or -129 if out of memory
+static int reserveVerts(struct wall_store *store, size_t n, bool exact) {
+	if (n > INT32_MAX) return -17;
+	if (n == 0 && exact) {
+		if (store->verts.cap) free(store->verts.x);
+		store->verts.x = store->verts.y = NULL;
+		store->verts.n = store->verts.cap = 0;
+		return 0;
+	}
+	if (n <= store->verts.cap && (!exact || n == store->verts.cap)) return 0;
+
+	size_t cap = n;
+	if (!exact && store->verts.cap + store->verts.cap / 2 > cap) {
+		cap = store->verts.cap + store->verts.cap / 2;
+		if (cap > INT32_MAX) cap = INT32_MAX;
+	}
+
+	float *x = malloc(2 * cap * sizeof(float));
+	if (!x) return -129;
+
+	const uint32_t keep = store->verts.n < cap ? store->verts.n : 0;
+	if (keep) {
+		memcpy(x, store->verts.x, keep * sizeof(float));
+		memcpy(x + cap, store->verts.y, keep * sizeof(float));
+	}
+	if (store->verts.cap) free(store->verts.x);
+
+	store->verts.x = x;
+	store->verts.y = x + cap;
+	store->verts.n = keep;
+	store->verts.cap = cap;
+	return 0;
+}
+
+// index of the vertex at p in a table, added to it as vertex *n if there isn't
+//	one there yet
+static uint32_t tableVert(struct vert_table *table, vect2i p, uint32_t *n) {
+	size_t h = (((uint32_t) p.x * 0x9E3779B1u) ^ ((uint32_t) p.y * 0x85EBCA77u))
+		& (table->size - 1);
+
+	for (; table->slots[h].v; h = (h + 1) & (table->size - 1)) {
+		if (table->slots[h].p.x == p.x && table->slots[h].p.y == p.y) {
+			return table->slots[h].v - 1;
+		}
+	}
+
+	table->slots[h].p = p;
+	table->slots[h].v = ++*n;
+	return *n - 1;
+}
+
+// index of the vertex at p, added to the store (which has to have room for
+//	it) if there isn't one yet
+static uint32_t addVert(struct wall_store *store, vect2i p) {
+	const uint32_t n = store->verts.n;
+	const uint32_t v = tableVert(store->verts.table, p, &store->verts.n);
+	if (v == n) {
+		store->verts.x[v] = p.x;
+		store->verts.y[v] = p.y;
+	}
+	return v;
+}
+
+// rebuild the vertices from the endpoints of every wall a sector uses, into
+//	exactly as much memory as they take; 0 or a negative error code
+static int bakeVerts(const struct level *level, struct wall_store *store) {
+	uint32_t live = 0;
+	for (size_t i = 0; i < level->sectors.n; i++) {
+		live += level->sectors.arr[i]->numwalls;
+	}
+
+	// keep the table at most a quarter full, it has to take the vertices of
+	//	walls added later too
+	size_t size = 1;
+	while (size < 4 * (size_t) live) size <<= 1;
+	free(store->verts.table);
+	struct vert_table *table = store->verts.table = allocVertTable(size);
+	if (!table) return -129;
+
+	// number the distinct endpoints first, then lay them out
+	uint32_t n = 0;
+	for (size_t i = 0; i < level->sectors.n; i++) {
+		const struct sector *sector = level->sectors.arr[i];
+
+		for (uint32_t j = sector->firstwall; j < sector->firstwall + sector->numwalls; j++) {
+			store->edges.va[j] = tableVert(table, store->walls[j].a, &n);
+			store->edges.vb[j] = tableVert(table, store->walls[j].b, &n);
+		}
+	}
+
+	store->verts.n = 0;
+	const int retval = reserveVerts(store, n, true);
+	if (retval != 0) return retval;
+
+	for (size_t h = 0; h < table->size; h++) {
+		if (!table->slots[h].v) continue;
+		store->verts.x[table->slots[h].v - 1] = table->slots[h].p.x;
+		store->verts.y[table->slots[h].v - 1] = table->slots[h].p.y;
+	}
+	store->verts.n = n;
+	return 0;
+}
+
+// copy the vertices (and their table) of one store to another, if there's
+//	the memory; otherwise the new store's are rebuilt the next time it's baked
+static void copyVerts(struct wall_store *dst, const struct wall_store *src) {
+	const struct vert_table *table = src->verts.table;
+	if (!table) return;
+
+	const size_t size = sizeof(struct vert_table) + table->size * sizeof(table->slots[0]);
+	if (!(dst->verts.table = malloc(size))) return;
+	if (reserveVerts(dst, src->verts.n, true) != 0) {
+		free(dst->verts.table);
+		dst->verts.table = NULL;
+		return;
+	}
+
+	memcpy(dst->verts.table, table, size);
+	memcpy(dst->verts.x, src->verts.x, src->verts.n * sizeof(float));
+	memcpy(dst->verts.y, src->verts.y, src->verts.n * sizeof(float));
+	dst->verts.n = src->verts.n;
+}
+
+// bake the walls, bounds and vertices of the sectors edited in this version;
+//	0 or a negative error code
+static int bakeWalls(struct level *level) {
+	struct wall_store *store = level->walls;
+
+	// walls can only have been edited if this version has a store of its own,
+	//	otherwise they're all shared and baked already
+	if (atomic_load(&store->refs) != 1) return 0;
+	const int checked = unpageWalls(level);
+	if (checked != 0) return checked;
+
+	uint32_t edited = 0;
+	for (size_t i = 0; i < level->sectors.n; i++) {
+		struct sector *sector = level->sectors.arr[i];
+		if (sector->version != level->version) continue; // shared, already baked
+
+		sector->bounds.min = sector->bounds.max = (vect2) { 0.0f, 0.0f };
+		for (uint32_t j = sector->firstwall; j < sector->firstwall + sector->numwalls; j++) {
+			const struct wall *wall = &store->walls[j];
+			store->edges.portal[j] = wall->portal;
+
+			// the inside of a sector is on the right of its walls (looking from
+			//	a to b), the side pointInEdges() accepts
+			const float dx = wall->b.x - wall->a.x, dy = wall->b.y - wall->a.y;
+			const float len = sqrtf(dx * dx + dy * dy);
+			store->edges.len[j] = len;
+			store->edges.nx[j] = len > 0.0f ? dy / len : 0.0f;
+			store->edges.ny[j] = len > 0.0f ? -dx / len : 0.0f;
+
+			const vect2 a = { wall->a.x, wall->a.y }, b = { wall->b.x, wall->b.y };
+			if (j == sector->firstwall) sector->bounds.min = sector->bounds.max = a;
+			sector->bounds.min.x = fminf(sector->bounds.min.x, fminf(a.x, b.x));
+			sector->bounds.min.y = fminf(sector->bounds.min.y, fminf(a.y, b.y));
+			sector->bounds.max.x = fmaxf(sector->bounds.max.x, fmaxf(a.x, b.x));
+			sector->bounds.max.y = fmaxf(sector->bounds.max.y, fmaxf(a.y, b.y));
+		}
+		edited += sector->numwalls;
+	}
+
+	// only the edited walls' endpoints have to be added while the table has
+	//	room for them (it stays at most half full)
+	const size_t verts = store->verts.n + 2 * (size_t) edited;
+	if (!store->verts.table || 2 * verts > store->verts.table->size
+		|| reserveVerts(store, verts, false) != 0) {
+		return bakeVerts(level, store);
+	}
+
+	for (size_t i = 0; i < level->sectors.n; i++) {
+		const struct sector *sector = level->sectors.arr[i];
+		if (sector->version != level->version) continue;
+
+		for (uint32_t j = sector->firstwall; j < sector->firstwall + sector->numwalls; j++) {
+			store->edges.va[j] = addVert(store, store->walls[j].a);
+			store->edges.vb[j] = addVert(store, store->walls[j].b);
+		}
+	}
+	return 0;
+}
+
+// a sector edited in this version as it was before it was baked
+struct grid_move {
+	uint32_t id;
+	struct sector was;
+};
+
+int bakeLevel(struct level *level) {
+	// the sectors edited in this version are moved in the grid from the
+	//	bounds they had to the ones they're baked with, unless there are so
+	//	many of them (or so many sectors added) that it's laid out again
+	struct grid_move *moves = NULL;
+	size_t n = 0;
+	if (level->grid.w) {
+		for (size_t i = 0; i < level->sectors.n; i++) {
+			n += level->sectors.arr[i]->version == level->version;
+		}
+		if (n && (n * 4 > level->sectors.n || level->sectors.n > 2 * level->grid.built
+			|| !(moves = malloc(n * sizeof(struct grid_move))))) {
+			freeGrid(level);
+			n = 0;
+		}
+		for (size_t i = 0, k = 0; k < n; i++) {
+			const struct sector *sector = level->sectors.arr[i];
+			if (sector->version != level->version) continue;
+
+			// however many walls it has now, it's taken out of the cells it
+			//	was baked in, if it was in any
+			moves[k].id = i;
+			memcpy(&moves[k].was, sector, sizeof(struct sector));
+			moves[k++].was.numwalls = 1;
+		}
+	}
+
+	const int retval = bakeWalls(level);
+	if (retval != 0) {
+		free(moves);
+		return retval;
+	}
+
+	bakeRanges(level);
+	for (size_t k = 0; k < n; k++) {
+		const struct sector *sector = level->sectors.arr[moves[k].id];
+
+		// a sector baked outside of the grid couldn't be found in it
+		const bool outside = inGrid(sector)
+			&& (sector->bounds.min.x < level->grid.min.x || sector->bounds.min.y < level->grid.min.y
+			|| sector->bounds.max.x > level->grid.max.x || sector->bounds.max.y > level->grid.max.y);
+		if (outside || !moveInGrid(level, moves[k].id, &moves[k].was, sector)) {
+			bakeGrid(level);
+			break;
+		}
+	}
+	free(moves);
+	return 0;
+}
+
+struct level *retainLevel(struct level *level) {
+	atomic_fetch_add(&level->refs, 1);
+	return level;
+}
+
+void releaseLevel(struct level *level) {
+	if (!level || atomic_fetch_sub(&level->refs, 1) != 1) return;
+
+	for (size_t i = 0; i < level->sectors.cap; i++) {
+		releaseSector(level->sectors.arr[i]);
+	}
+	releaseWalls(level->walls);
+	free(level->sectors.arr);
+	free(level->ranges.first);
+	free(level->ranges.num);
+	free(level->ranges.page);
+	freeGrid(level);
+	free(level);
+}
+
+struct level *forkLevel(const struct level *level) {
+	struct level *fork = allocLevel();
+	if (!fork) return NULL;
+
+	if (reserveSectors(fork, level->sectors.n)) {
+		releaseLevel(fork);
+		return NULL;
+	}
+
+	fork->sectors.n = level->sectors.n;
+	for (size_t i = 0; i < level->sectors.n; i++) {
+		struct sector *sector = level->sectors.arr[i];
+		atomic_fetch_add(&sector->refs, 1);
+		fork->sectors.arr[i] = sector;
+	}
+
+	atomic_fetch_add(&level->walls->refs, 1);
+	fork->walls = level->walls;
+	memcpy(fork->ranges.first, level->ranges.first, level->sectors.n * sizeof(uint32_t));
+	memcpy(fork->ranges.num, level->ranges.num, level->sectors.n * sizeof(uint32_t));
+	memcpy(fork->ranges.page, level->ranges.page, level->sectors.n * sizeof(uint32_t));
+	fork->maxwalls = level->maxwalls;
+
+	// and so are the grid's tiles, until an edit moves a sector in one;
+	//	without the memory for them the fork's grid is laid out when it's baked
+	const size_t tiles = (size_t) level->grid.tw * level->grid.th;
+	if (level->grid.w && (fork->grid.tiles = malloc(tiles * sizeof(struct grid_tile *)))) {
+		struct grid_tile **shared = fork->grid.tiles;
+		fork->grid = level->grid;
+		fork->grid.tiles = shared;
+		for (size_t t = 0; t < tiles; t++) {
+			atomic_fetch_add(&level->grid.tiles[t]->refs, 1);
+			shared[t] = level->grid.tiles[t];
+		}
+	}
+	return fork;
+}
+
+struct sector *editSector(struct level *level, size_t id) {
+	struct sector *sector = level->sectors.arr[id];
+	if (sector->version == level->version) {
+		return sector; // already private to this version
+	}
+
+	struct sector *copy = malloc(sizeof(struct sector));
+	if (!copy) return NULL;
+
+	memcpy(copy, sector, sizeof(struct sector));
+	atomic_init(&copy->refs, 1);
+	copy->version = level->version;
+
+	level->sectors.arr[id] = copy;
+	releaseSector(sector);
+	return copy;
+}
+
+// give an unpublished version a store of its own with room for at least extra
+//	more walls. once more than half of the old store is walls no sector uses
+//	any more, only the used ones are copied, which means every sector has to be
+//	copied too so it can point at its walls' new place
+static struct wall_store *copyWalls(struct level *level, uint32_t extra) {
+	struct wall_store *old = level->walls;
+
+	// none of the copy's walls are paged, so they all have to be fine; only
+	//	the old store is read, other versions might be paging it
+	if (old->pages.n && checkWalls(old, 0, old->n, level->sectors.n) != 0) return NULL;
+
+	uint32_t live = 0;
+	for (size_t i = 0; i < level->sectors.n; i++) {
+		live += level->sectors.arr[i]->numwalls;
+	}
+
+	const bool compact = old->n - live > live;
+	const uint32_t n = compact ? live : old->n;
+
+	struct wall_store *store = allocWalls(n + extra + n / 2);
+	if (!store) return NULL;
+
+	if (compact) {
+		for (size_t i = 0; i < level->sectors.n; i++) {
+			if (!editSector(level, i)) {
+				releaseWalls(store);
+				return NULL;
+			}
+		}
+
+		for (size_t i = 0; i < level->sectors.n; i++) {
+			struct sector *sector = level->sectors.arr[i];
+			moveWalls(store, store->n, old, sector->firstwall, sector->numwalls);
+			sector->firstwall = store->n;
+			store->n += sector->numwalls;
+		}
+	} else {
+		moveWalls(store, 0, old, 0, old->n);
+		store->n = old->n;
+		copyVerts(store, old);
+	}
+
+	level->walls = store;
+	releaseWalls(old);
+	return store;
+}
+
+struct wall *editWalls(struct level *level, size_t id, uint32_t numwalls) {
+	struct sector *sector = editSector(level, id);
+	if (!sector) return NULL;
+
+	// walls are changed in place only if no other version can see the store,
+	//	and growing might need to move the sector's walls to the end of it
+	struct wall_store *store = level->walls;
+	if (atomic_load(&store->refs) != 1 || store->n + numwalls > store->cap) {
+		if (!(store = copyWalls(level, numwalls))) return NULL;
+	}
+
+	if (unpageWalls(level) != 0) return NULL;
+	const bool last = sector->firstwall + sector->numwalls == store->n;
+
+	if (numwalls > sector->numwalls) {
+		if (!last) {
+			moveWalls(store, store->n, store, sector->firstwall, sector->numwalls);
+			sector->firstwall = store->n;
+		}
+
+		memset(&store->walls[sector->firstwall + sector->numwalls], 0,
+			(numwalls - sector->numwalls) * sizeof(struct wall));
+		store->n = sector->firstwall + numwalls;
+	} else if (last) {
+		store->n = sector->firstwall + numwalls; // give back what's left at the end
+	}
+
+	sector->numwalls = numwalls;
+	return &store->walls[sector->firstwall];
+}
+
+struct sector *newSector(struct level *level) {
+	if (reserveSectors(level, level->sectors.n + 1)) return NULL;
+
+	struct sector *sector = allocSector(level->version);
+	if (!sector) return NULL;
+
+	sector->id = level->sectors.n;
+	sector->firstwall = level->walls->n;
+	sector->zfloor = 0.0f; sector->zceil = 5.0f;
+
+	level->sectors.arr[level->sectors.n++] = sector;
+	return sector;
+}
+
+// whether a sector of one level is the same as a sector of another
+static bool sameSector(const struct level *a, const struct sector *sa,
+	const struct level *b, const struct sector *sb) {
+	return !memcmp(&sa->zfloor, &sb->zfloor, sizeof(float))
+		&& !memcmp(&sa->zceil, &sb->zceil, sizeof(float))
+		&& sa->numwalls == sb->numwalls
+		&& !memcmp(sectorWalls(a, sa), sectorWalls(b, sb), sa->numwalls * sizeof(struct wall));
+}
+
+struct level *patchLevel(const struct level *base, const struct level *target, size_t *changed) {
+	struct level *level = forkLevel(base);
+	if (!level) return NULL;
+
+	*changed = 0;
+
+	// sectors the target doesn't have any more; nothing left can have a
+	//	portal to them, or the target wouldn't have been valid
+	while (level->sectors.n > target->sectors.n) {
+		--level->sectors.n;
+		if (!moveInGrid(level, level->sectors.n, level->sectors.arr[level->sectors.n], NULL)) {
+			freeGrid(level); // laid out again when it's baked
+		}
+		releaseSector(level->sectors.arr[level->sectors.n]);
+		level->sectors.arr[level->sectors.n] = NULL;
+		++*changed;
+	}
+
+	for (size_t i = 1; i < target->sectors.n; i++) {
+		const struct sector *want = target->sectors.arr[i];
+
+		if (i == level->sectors.n) {
+			if (!newSector(level)) goto fail;
+		} else if (sameSector(base, base->sectors.arr[i], target, want)) {
+			continue;
+		}
+
+		struct wall *walls = editWalls(level, i, want->numwalls);
+		if (!walls) goto fail;
+		memcpy(walls, sectorWalls(target, want), want->numwalls * sizeof(struct wall));
+
+		struct sector *sector = level->sectors.arr[i]; // private since editWalls()
+		sector->zfloor = want->zfloor;
+		sector->zceil = want->zceil;
+		++*changed;
+	}
+
+	if (bakeLevel(level) != 0) goto fail;
+	level->load = target->load;
+	return level;
+
+fail:
+	releaseLevel(level);
+	return NULL;
+}
@@ -0,0 +1,314 @@
+#ifndef LEVEL_H
+#define LEVEL_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "config.h"
+
+typedef struct vect2_s {
+	float x, y;
+} vect2;
+
+typedef struct vect2i_s {
+	int32_t x, y;
+} vect2i;
+
+struct wall {
+	vect2i a, b;
+	int32_t portal; // 0 for not a portal, otherwise the sector it's a portal to
+};
+
+// every wall of a level in one array, sectors own a contiguous range of it.
+//	stores are shared between versions of a level like sectors are, a version
+//	that edits walls copies the store first unless it's the only one using it
+struct wall_store {
+	atomic_int refs; // number of level versions using this store
+	uint32_t n, cap;
+	struct wall *walls;
+
+	// the walls in separate arrays so that several walls can be transformed
+	//	or tested at a time, baked from walls by bakeLevel(); their endpoints
+	//	are only in verts
+	struct {
+		float *nx, *ny, *len; // unit normal pointing into the sector, and length
+		int32_t *portal;
+		uint32_t *va, *vb; // indices of the endpoints in verts
+	} edges;
+
+	// the distinct endpoints of the walls in use: walls share them with the
+	//	walls next to them and with the portal on the other side, so this is
+	//	what's worth transforming. bakeLevel() adds the endpoints of the walls
+	//	that changed, looking them up in the table, and rebuilds the lot once
+	//	too many are left over from walls that are gone. there are never more
+	//	than INT32_MAX of them
+	struct {
+		float *x, *y; // y is x + cap
+		uint32_t n, cap; // cap is 0 if they're in a mapped file, not allocated
+		struct vert_table *table; // NULL until they're baked in this store
+	} verts;
+
+	// a store loaded from a binary level file points straight into the file,
+	//	which stays mapped until the store is released
+	void *mapping;
+	size_t mappingSize;
+
+	// the mapped walls come in pages, runs of walls of sectors that are near
+	//	each other, which the system only keeps in memory while they're near
+	//	the player (see pageLevel()). n is 0 if the store isn't paged, or not
+	//	any more since it's been written to
+	struct {
+		uint32_t n;
+		const uint32_t *first; // first wall of each page, in the file
+		bool *resident;
+
+		// a page's walls are only checked when they're first going to be
+		//	used: 0 until then, 1 if they're fine or the error they have
+		int8_t *checked;
+
+		// where pageLevel() last left them
+		unsigned version; size_t sector, budget;
+	} pages;
+};
+
+// sectors are shared between versions of a level and never change once a
+//	version is published; only the version that created a sector may edit it
+struct sector {
+	atomic_int refs; // number of level versions using this sector
+	unsigned version; // version of the level this sector was created in
+
+	int id;
+	uint32_t firstwall, numwalls; // this sector's range of the level's walls
+	float zfloor, zceil;
+	struct { vect2 min, max; } bounds; // box around the walls, baked with them
+};
+
+// GRID_TILE by GRID_TILE cells of a level's grid, cell c (counted across
+//	then down) lists ids[start[c]] up to ids[start[c + 1]], in order. tiles
+//	are refcounted and never change once they're shared
+#define GRID_TILE 16
+struct grid_tile {
+	atomic_int refs;
+	uint32_t start[GRID_TILE * GRID_TILE + 1];
+	uint32_t ids[];
+};
+
+// one immutable version (snapshot) of a map; a level is only handed to the
+//	renderer once it has been completely loaded and validated. editing makes a
+//	new version which shares every sector that wasn't touched with the old one,
+//	so anyone still reading the old version can keep doing so
+struct level {
+	atomic_int refs; // readers and owners holding this version
+	unsigned version;
+
+	// sized to the level when it's loaded and grown as sectors are added
+	struct {
+		struct sector **arr; size_t n, cap;
+	} sectors;
+
+	struct wall_store *walls;
+
+	// each sector's range of walls by id, baked from the sectors so that the
+	//	renderer can go from a portal to the walls behind it without loading the
+	//	sector itself
+	struct {
+		uint32_t *first, *num; // room for sectors.cap of each
+		uint32_t *page; // page of the store each sector's walls are in
+	} ranges;
+	uint32_t maxwalls; // the most walls any one sector has
+
+	// the sectors by where they are, baked from their bounds: a grid over the
+	//	level, each cell listing the ids of the sectors whose bounds overlap
+	//	it. the cells come in tiles, tw across and th down, which versions
+	//	share until an edit moves a sector in or out of one
+	struct {
+		vect2 min, max;
+		float scale; // cells per unit
+		uint32_t w, h; // 0 if there's no grid
+		uint32_t tw, th;
+		struct grid_tile **tiles;
+		size_t built; // number of sectors when the grid was laid out
+	} grid;
+
+	// size of the file this version was loaded from and how long loading took,
+	//	both 0 for versions made by editing
+	struct {
+		size_t bytes;
+		double seconds;
+		bool cached; // mapped from the level cache rather than parsed
+	} load;
+};
+
+// whether the walls of the sector with this id are in memory (and have been
+//	checked); a portal to one that isn't has to be treated like a wall
+static inline bool sectorResident(const struct level *level, size_t id) {
+	const struct wall_store *store = level->walls;
+	return store->pages.n == 0 || store->pages.resident[level->ranges.page[id]];
+}
+
+// cell of the grid a coordinate is in along one axis, clamped to the grid
+//	(one that isn't a number is in the first)
+static inline uint32_t gridCell(float v, float min, float scale, uint32_t cells) {
+	const float c = (v - min) * scale;
+	return !(c > 0.0f) ? 0 : c >= (float) (cells - 1) ? cells - 1 : (uint32_t) c;
+}
+
+// ids of the sectors that might contain p, *n of them (none if p is outside
+//	of every sector's bounds, or isn't a number)
+static inline const uint32_t *sectorsNear(const struct level *level, vect2 p, size_t *n) {
+	*n = 0;
+	if (level->grid.w == 0 || !(p.x >= level->grid.min.x && p.x <= level->grid.max.x
+		&& p.y >= level->grid.min.y && p.y <= level->grid.max.y)) {
+		return NULL;
+	}
+
+	const uint32_t
+		x = gridCell(p.x, level->grid.min.x, level->grid.scale, level->grid.w),
+		y = gridCell(p.y, level->grid.min.y, level->grid.scale, level->grid.h),
+		c = (y % GRID_TILE) * GRID_TILE + x % GRID_TILE;
+	const struct grid_tile *tile =
+		level->grid.tiles[(y / GRID_TILE) * level->grid.tw + x / GRID_TILE];
+
+	*n = tile->start[c + 1] - tile->start[c];
+	return &tile->ids[tile->start[c]];
+}
+
+// a sector's walls, sector->numwalls of them
+static inline const struct wall *sectorWalls(
+	const struct level *level, const struct sector *sector) {
+	return &level->walls->walls[sector->firstwall];
+}
+
+// allocate a new level and load it from a file (JSON, the binary format or
+//	the tables of level.txt, told apart by the file's contents), returns 0 on
+//	success or a negative error code (the level is not allocated on failure);
+//	the caller owns the only reference. if the environment variable
+//	LEVEL_CACHE_ENV names a directory, text files are looked up there by the
+//	hash of their contents, and kept there in the binary format once parsed
+int loadLevel(const char *path, struct level **out);
+
+// byte offset in the file of the error the last loadLevel() on this thread
+//	returned, -1 if it wasn't about a particular place in the file
+long levelErrorOffset(void);
+
+// report on stderr why a level couldn't be loaded, and where in the file if
+//	it's known (on the thread that tried to load it)
+void printLoadError(int status);
+
+// report on stderr the size of a newly loaded level and how fast it was read
+void printLoaded(const struct level *level);
+
+// write a baked level as JSON or in the binary format, which can be loaded
+//	without parsing; returns 0 or a negative error code (-8 or -9 if a
+//	sector's floor or ceiling height can't be written as JSON)
+int saveLevelJSON(const struct level *level, const char *path);
+int saveLevelBinary(const struct level *level, const char *path);
+
+// write a level as JSON if the path ends in .json, in the binary format if not
+int saveLevel(const struct level *level, const char *path);
+
+// take or drop a reference to a version, the last release frees it
+struct level *retainLevel(struct level *level);
+void releaseLevel(struct level *level);
+
+// start a new, unpublished version of a level that shares all of its sectors
+struct level *forkLevel(const struct level *level);
+
+// get a sector of an unpublished version for editing; it's copied the first
+//	time it's edited in this version so older versions never see the change
+struct sector *editSector(struct level *level, size_t id);
+
+// get a sector's walls in an unpublished version for editing, resized to
+//	numwalls (new walls are zeroed); the pointer is valid until the next call.
+//	NULL if out of memory, or if a level file's walls turn out to be bad
+struct wall *editWalls(struct level *level, size_t id, uint32_t numwalls);
+
+// append an empty sector to an unpublished version, NULL if out of memory
+struct sector *newSector(struct level *level);
+
+// recompute the derived data of every sector loaded or edited in this version,
+//	has to be done before the version is published; returns 0 or -129 if out
+//	of memory, in which case the version can't be published
+int bakeLevel(struct level *level);
+
+// keep the pages of a level's walls that are nearest (through portals) to the
+//	sector with this id in memory, as many as fit in budget bytes, and let the
+//	system have the memory of the rest back. the sector's own page is kept
+//	whatever the budget. only does anything once the sector, the version or
+//	the budget changes. a page's walls are checked the first time it's
+//	wanted, one with bad walls is never paged in
+void pageLevel(const struct level *level, size_t id, size_t budget);
+
+// check the walls of every page of a paged level now and treat them all as
+//	paged in, for going through the whole level; 0 or the error loadLevel()
+//	would have returned for them (-20 or -22)
+int checkLevel(const struct level *level);
+
+// a ray from origin in the sector with this id (SECTOR_NONE to look it up)
+//	along dir, as far as maxDist
+struct ray {
+	vect2 origin, dir;
+	float maxDist;
+	int sector;
+};
+
+// where a ray ended: at distance along it, in sector, against the sector's
+//	wall with this index (UINT32_MAX if it didn't hit one). a ray that starts
+//	outside of every sector ends in SECTOR_NONE where it starts
+struct ray_hit {
+	int sector;
+	uint32_t wall;
+	float distance;
+};
+
+// follow a ray through the portals of a baked level, testing only the walls
+//	of the sectors it goes through; returns whether it hit a wall before
+//	maxDist. a portal to a sector that isn't paged in counts as a wall. it
+//	only reads the level, so any number of threads can cast rays at once
+//	(while it isn't being paged)
+bool castRay(const struct level *level, const struct ray *ray, struct ray_hit *hit);
+
+// test n points against a baked sector at once, inside[i] is set for the
+//	point (px[i], py[i]) if it's on the inside of, or on, every wall; uses
+//	whichever SIMD path is in use (see simd.h)
+void pointsInSector(const struct level *level, const struct sector *sector,
+	const float *px, const float *py, size_t n, bool *inside);
+
+// cast n rays, hits[i] is set for rays[i]; they're cast grouped by the
+//	sector they start in. a big batch can be split between threads, each
+//	casting a part of it. returns 0 or a negative error code
+int castRays(const struct level *level, const struct ray *rays, struct ray_hit *hits, size_t n);
+
+// a wall that blocks a move, see collideMove(), with its baked normal (facing
+//	into its sector) and length
+struct blocker {
+	vect2 a, b;
+	vect2 normal;
+	float len;
+};
+
+// walls that might block a move, which grows as needed; zeroed to start
+//	with and kept for every move, arr is the caller's to free
+struct blocker_list {
+	struct blocker *arr;
+	size_t n, cap;
+};
+
+// move a circle of radius r in sector id from p by v, stopping at the walls
+//	it would hit and sliding along them with what's left of the move; returns
+//	where it ends up. only the walls of the sector and of the sectors through
+//	its portals the circle fits through (see PLAYER_HEIGHT and STEP_HEIGHT)
+//	are tested, so the move has to be short compared to them. the walls are
+//	gathered in list, so threads moving things at once each need their own
+vect2 collideMove(const struct level *level, int id, vect2 p, vect2 v, float r,
+	struct blocker_list *list);
+
+// make a new, baked version of base that's the same as target, where every
+//	sector that's the same in both is shared with base so only the ones that
+//	changed are copied and baked. *changed is set to the number of sectors
+//	changed, added or removed; NULL if out of memory
+struct level *patchLevel(const struct level *base, const struct level *target, size_t *changed);
+
+#endif
@@ -4,9 +4,18 @@
 #include <stdint.h>
 #include <assert.h>
 #include <math.h>
+#include <sys/stat.h>
 #include <SDL.h>
 
-#include "cJSON.h"
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "config.h"
+#include "framebuffer.h"
+#include "level.h"
+#include "simd.h"
 
 #define NK_INCLUDE_FIXED_TYPES
 #define NK_INCLUDE_STANDARD_IO
@@ -20,20 +29,11 @@
 #include "nuklear.h"
 #include "nuklear_sdl_renderer.h"
 
-#define PROJECT_NAME "Raycast"
-#define SCREEN_WIDTH 384
-#define SCREEN_HEIGHT 256
-
 #define PI 3.14159265359f
 #define TAU (2.0f * PI)
 #define PI_2 (PI / 2.0f)
 #define PI_4 (PI / 4.0f)
 
-#define SECTOR_NONE 0
-
-#define NUMSECTORS_MAX 1024
-#define NUMWALLS_MAX 512
-
 #define DEG2RAD(_d) ((_d) * (PI / 180.0f))
 #define RAD2DEG(_d) ((_d) * (180.0f / PI))
 
@@ -44,6 +44,18 @@
 #define ZNEAR 0.0001f
 #define ZFAR 128.0f
 
+#define PLAYER_RADIUS 0.2f // how close the player gets to walls
+
+#define VOID_COLOR 0x00000000 // wherever no sector covers the screen
+#define FOG_COLOR 0xFF606060 // portals to sectors that aren't in memory
+
+// how much of a screen column the renderer has drawn, see render()
+enum {
+	COVERED_LO = 1 << 0, // the pixel at y_lo has been drawn
+	COVERED_HI = 1 << 1, // the pixel at y_hi has been drawn
+	COVERED_ALL = 1 << 2 // a solid wall (or closed portal window) filled the column
+};
+
 #define ifnan(_x, _alt) ({ __typeof__(_x) __x = (_x); isnan(__x) ? (_alt) : __x; })
 
 // -1 right, 0 on, 1 left
@@ -53,25 +65,13 @@
 	- ((__p.y - __a.y) * (__b.x - __a.x)));				\
 })
 
+// id of sector and left and right bounds of portal window
+struct queue_entry { int id, x0, x1; };
 
-typedef struct vect2_s {
-	float x, y;
-} vect2;
-
-typedef struct vect2i_s {
-	int32_t x, y;
-} vect2i;
-
-struct wall {
-	vect2i a, b;
-	int portal; // 0 for not a portal, otherwise the sector it's a portal to
-};
-
-struct sector {
-	int id;
-	size_t numwalls;
-	float zfloor, zceil;
-	struct wall walls[NUMWALLS_MAX];
+// queue of sectors to render, which grows as needed
+struct render_queue {
+	struct queue_entry *arr;
+	size_t n, cap;
 };
 
 // global state object
@@ -79,7 +79,7 @@ struct {
 	SDL_Window *window;
 	SDL_Renderer *renderer;
 	SDL_Texture *texture;
-	uint32_t *pixels;
+	struct framebuffer *frame; // what's rendered, copied to the texture by present()
 
 	struct nk_context *ctx;
 	nk_bool editorOpen;
@@ -89,10 +89,35 @@ struct {
 	nk_bool slomo;
 	nk_bool effects;
 	nk_bool noclip;
+	nk_bool fillUncovered; // only clear pixels that weren't drawn rather than the whole frame
+	int simd; // enum simd_path in use
+	int pageBudget; // megabytes of the level's pages kept in memory, see pageLevel()
+
+	// current version of the level being played; replaced (never modified) by
+	//	the editor and the loader, readers hold on to the version they started with
+	struct level *level;
+	SDL_mutex *levelLock; // guards replacing 'level' against taking a reference
 
+	// levels are loaded on a worker thread and handed over through 'pending',
+	//	which the main loop swaps in at the start of the next frame
 	struct {
-		struct sector arr[NUMSECTORS_MAX]; size_t n;
-	} sectors;
+		SDL_Thread *thread;
+		SDL_atomic_t busy;
+		SDL_atomic_t status;
+		char path[64];
+		bool reload; // patch the level into the current one instead of replacing it
+		void *pending; // struct level *, only accessed atomically
+	} loader;
+
+	// the file the level came from is watched (on Linux) and reloaded in the
+	//	background whenever it changes
+	struct {
+		int fd, wd; // inotify instance and the watch on the file's directory
+		char path[64];
+		const char *name; // the file's name in that directory, part of path
+		bool changed; // changed while the loader was busy, reload once it isn't
+		struct stat saved; // the file as saveCurrentLevel() left it
+	} watch;
 
 	struct {
 		vect2 pos;
@@ -100,6 +125,24 @@ struct {
 		int sector;
 	} camera;
 
+	// buffers render() needs every frame, grown to fit the biggest level (and
+	//	sector) drawn so far instead of being sized for the worst case up front
+	struct {
+		bool *sectdraw; size_t sectors;
+		float *wx, *wy, *cx, *cy; uint32_t *todo; size_t points;
+		struct render_queue queue;
+		struct blocker_list blockers; // for collideMove()
+	} scratch;
+
+	// camera space positions of the level's vertices, each one is transformed
+	//	the first time it's needed in a frame and is valid only while its stamp
+	//	matches the epoch of the frame being rendered
+	struct {
+		uint32_t epoch, cap;
+		uint32_t *stamp;
+		float *x, *y;
+	} verts;
+
 	vect2 positionBeforeWorldExit; // the player's final position before exiting the world
 	int sectorBeforeWorldExit;
 
@@ -193,209 +236,160 @@ float normalizeAngle(float angle) {
 }
 
 // point is in sector if it is on the left side of all the sector's walls
-bool pointInSector(const struct sector *sector, vect2 p) {
-	for (size_t i = 0; i < sector->numwalls; i++) {
-		const struct wall *wall = &sector->walls[i];
-	
-		if (pointSide(p, vect2iToVect2(wall->a), vect2iToVect2(wall->b)) > 0) {
-			return false;
-		}
-	}
-	return true;
-}
-
-uint32_t colorMult(uint32_t color, uint32_t a) {
-	const uint32_t blueRed = ((color & 0xFF00FF) * a) >> 8;
-	const uint32_t green   = ((color & 0x00FF00) * a) >> 8;
-
-	return 0xFF000000 | (blueRed & 0xFF00FF) | (green & 0x00FF00);
+//	(pointSide() <= 0), tested against several walls at a time
+bool pointInSector(const struct level *level, const struct sector *sector, vect2 p) {
+	const uint32_t i = sector->firstwall;
+	const struct wall_store *store = level->walls;
+	return pointInEdges(store->verts.x, store->verts.y, &store->edges.va[i], &store->edges.vb[i],
+		sector->numwalls, p.x, p.y);
 }
 
-// translate and rotate world space to camera space
-vect2 worldPosToCamera(vect2 p) {
-	const vect2 u = { p.x - state.camera.pos.x, p.y - state.camera.pos.y };
-	return (vect2) {
-		u.x * state.camera.anglesin - u.y * state.camera.anglecos,
-		u.x * state.camera.anglecos + u.y * state.camera.anglesin
-	};
-}
-
-// load sectors and walls from file
-int loadSectors(const char *path) {
-	state.sectors.n = 1; // there's no sector 0
-
-	FILE *f = fopen(path, "r");
-	if (!f) return -1; // file not found (or couldn't be opened)
-
-	char *buf = malloc(1024 * 128); // 128 KB
-
-	int retval = 0;
-	fseek(f, 0L, SEEK_END); // seek to the end of the file
-	long size = ftell(f); // get position, equivalent to the size of the file
-	rewind(f); // go back to the beginning of the file
-
-	if (size == -1) { retval = -2; goto done; } // error reading file size
-
-	if (size > (long) 1024 * 128 - 8) {
-		retval = -3; goto done; // file size too large
+// follow a move from p0 to p1 out of the sector id through the portals it
+//	crosses, testing only the walls of the sectors on the way; returns the
+//	sector p1 is in, or SECTOR_NONE if the move goes through a wall or p0
+//	wasn't in the sector to begin with
+int traceSector(const struct level *level, int id, vect2 p0, vect2 p1) {
+	if (id == SECTOR_NONE || (size_t) id >= level->sectors.n || !sectorResident(level, id)) {
+		return SECTOR_NONE;
 	}
 
-	size_t newLen = fread(buf, sizeof(char), 1024 * 128, f);
-	buf[++newLen] = '\0'; // guarantee that it's null-terminated
-
-	if (ferror(f)) { retval = -128; goto done; }
-
-	cJSON *json = cJSON_Parse(buf);
-	if (!json) {
-		const char *error_ptr = cJSON_GetErrorPtr();
-		if (error_ptr) {
-			// fprintf(stderr, "%s", error_ptr);
+	// every crossing leads into another sector, a move can't cross more
+	//	portals than there are sectors without going round in circles
+	for (size_t steps = 0; steps < level->sectors.n; steps++) {
+		if (pointInSector(level, level->sectors.arr[id], p1)) return id;
+
+		const uint32_t first = level->ranges.first[id];
+		const float *vx = level->walls->verts.x, *vy = level->walls->verts.y;
+		const uint32_t *va = &level->walls->edges.va[first], *vb = &level->walls->edges.vb[first];
+		const int32_t *portals = &level->walls->edges.portal[first];
+
+		// the move leaves through the nearest wall it crosses that p1 is
+		//	outside of (which isn't the one it came in through)
+		int next = SECTOR_NONE;
+		float nearest = INFINITY;
+		for (size_t i = 0; i < level->ranges.num[id]; i++) {
+			const vect2 a = { vx[va[i]], vy[va[i]] }, b = { vx[vb[i]], vy[vb[i]] };
+			if (pointSide(p1, a, b) <= 0) continue;
+
+			const vect2 x = intersectSegs(p0, p1, a, b);
+			if (isnan(x.x)) continue;
+
+			const float d = length((vect2) { x.x - p0.x, x.y - p0.y });
+			if (d < nearest) {
+				nearest = d;
+				next = portals[i];
+			}
 		}
-		retval = -4; goto done;
-	}
 
-	cJSON *csector = NULL;
-	cJSON *csectors = cJSON_GetObjectItemCaseSensitive(json, "sectors"); // does null check for us
-	if (!cJSON_IsArray(csectors)) {
-		retval = -5; goto done;
+		if (next == SECTOR_NONE || !sectorResident(level, next)) return SECTOR_NONE;
+		id = next;
 	}
+	return SECTOR_NONE;
+}
 
-	for (csector = csectors->child; csector != NULL; csector = csector->next) {
-		cJSON *cid = cJSON_GetArrayItem(csector, 0);
-		if (!cJSON_IsNumber(cid)) {
-			retval  = -7; goto done;
-		}
-		int id = (int) cJSON_GetNumberValue(cid);
-
-		if (id >= NUMSECTORS_MAX) {
-			retval = -18; goto done;
-		}
-
-		struct sector *sector = &state.sectors.arr[id];
-		sector->id = id;
-
-		cJSON *czfloor = cJSON_GetArrayItem(csector, 1);
-		if(!cJSON_IsNumber(czfloor)) {
-			retval = -8; goto done;
-		}
-		float zfloor = (float) cJSON_GetNumberValue(czfloor);
-		sector->zfloor = zfloor;
+// look for the sector p is in through the portals from the sector start
+int searchSector(const struct level *level, int start, vect2 p) {
+	// BFS neighbors because player is likely to be in a neighboring sector.
+	//	every sector is queued at most once, so the queue never overflows
+	bool *seen = calloc(level->sectors.n, sizeof(bool));
+	uint32_t *queue = malloc(level->sectors.n * sizeof(uint32_t));
+	int found = SECTOR_NONE;
+	if (!sectorResident(level, start)) goto done;
+	if (!seen || !queue) {
+		if (state.displayErrors) fprintf(stderr, "out of memory for the sector BFS\n");
+		goto done;
+	}
 
-		cJSON *czceil = cJSON_GetArrayItem(csector, 2);
-		if (!cJSON_IsNumber(czceil)) {
-			retval = -9; goto done;
-		}
-		float zceil = (float) cJSON_GetNumberValue(czceil);
-		sector->zceil = zceil;
+	size_t head = 0, tail = 0;
+	queue[tail++] = start;
+	seen[start] = true;
+	while (head != tail) {
+		const uint32_t id = queue[head++];
+		const struct sector *sector = level->sectors.arr[id];
 
-		cJSON *cwalls = cJSON_GetArrayItem(csector, 3);
-		cJSON *cwall = NULL;
-		if (!cJSON_IsArray(cwalls)) {
-			retval = -10; goto done;
+		if (pointInSector(level, sector, p)) {
+			found = id;
+			break;
 		}
 
-		int numwalls = cJSON_GetArraySize(cwalls);
-		sector->numwalls = numwalls;
-
-		int i = 0;
-		for (cwall = cwalls->child; cwall != NULL; cwall = cwall->next) {
-			if (i >= NUMWALLS_MAX) {
-				retval = -17; goto done;
-			}
-
-			if (cJSON_GetArraySize(cwall) != 5) {
-				retval = -11; goto done;
-			}
-
-			cJSON *cx0 = cJSON_GetArrayItem(cwall, 0);
-			if (!cJSON_IsNumber(cx0)) {
-				retval = -12; goto done;
-			}
-			int x0 = (int) cJSON_GetNumberValue(cx0);
-
-			cJSON *cy0 = cJSON_GetArrayItem(cwall, 1);
-			if (!cJSON_IsNumber(cy0)) {
-				retval = -13; goto done;
-			}
-			int y0 = (int) cJSON_GetNumberValue(cy0);
-
-			cJSON *cx1 = cJSON_GetArrayItem(cwall, 2);
-			if (!cJSON_IsNumber(cx1)) {
-				retval = -14; goto done;
-			}
-			int x1 = (int) cJSON_GetNumberValue(cx1);
-
-			cJSON *cy1 = cJSON_GetArrayItem(cwall, 3);
-			if (!cJSON_IsNumber(cy1)) {
-				retval = -15; goto done;
+		// check neighbors
+		const int32_t *portals = &level->walls->edges.portal[level->ranges.first[id]];
+		for (size_t j = 0; j < level->ranges.num[id]; j++) {
+			if (portals[j] != SECTOR_NONE && !seen[portals[j]] && sectorResident(level, portals[j])) {
+				seen[portals[j]] = true;
+				queue[tail++] = portals[j];
 			}
-			int y1 = (int) cJSON_GetNumberValue(cy1);
+		}
+	}
 
-			cJSON *cportal = cJSON_GetArrayItem(cwall, 4);
-			if (!cJSON_IsNumber(cportal)) {
-				retval = -16; goto done;
-			}
-			int portal = (int) cJSON_GetNumberValue(cportal);
+done:
+	free(seen);
+	free(queue);
+	return found;
+}
 
-			vect2i a = { x0, y0 };
-			vect2i b = { x1, y1 };
+// the sector p is in, SECTOR_NONE if it's outside of the world. the sector it
+//	was in last is tried first, then the ones the level's grid has near p
+int findSector(const struct level *level, int last, vect2 p) {
+	const bool valid = last != SECTOR_NONE && (size_t) last < level->sectors.n
+		&& sectorResident(level, last);
+	if (valid && pointInSector(level, level->sectors.arr[last], p)) {
+		return last;
+	}
 
-			sector->walls[i] = (struct wall) { a, b, portal };
-			i++;
+	// a sector that isn't paged in (like every one of a level that was just
+	//	loaded) is paged in to be tested
+	size_t n;
+	const uint32_t *near = sectorsNear(level, p, &n);
+	for (size_t i = 0; i < n; i++) {
+		if (!sectorResident(level, near[i])) pageLevel(level, near[i], (size_t) state.pageBudget << 20);
+		if (sectorResident(level, near[i]) && pointInSector(level, level->sectors.arr[near[i]], p)) {
+			return near[i];
 		}
-		state.sectors.n++;
 	}
 
-	// free memory used by json object;
-	//	not critical to do in 'done' since the program's about to terminate if there's any error
-	cJSON_Delete(json);
-done:
-	fclose(f);
-	free(buf);
-	return retval;
+	// there's only no grid if there wasn't the memory for one
+	return level->grid.w == 0 && valid ? searchSector(level, last, p) : SECTOR_NONE;
 }
 
-void newSector(void) {
-	if (state.sectors.n + 1 < NUMSECTORS_MAX) {
-		struct sector *sector = &state.sectors.arr[state.sectors.n++];
-		sector->numwalls = 0; sector->zfloor = 0.0f; sector->zceil = 5.0f;
-	} 
-} 
+uint32_t colorMult(uint32_t color, uint32_t a) {
+	const uint32_t blueRed = ((color & 0xFF00FF) * a) >> 8;
+	const uint32_t green   = ((color & 0x00FF00) * a) >> 8;
 
-void newWall(struct sector *sector) {
-	if (sector->numwalls + 1 < NUMWALLS_MAX) {
-		struct wall *wall = &sector->walls[sector->numwalls++];
-		vect2i a = { 0, 0 }, b = { 0, 0 };
-		wall->a = a; wall->b = b; wall->portal = 0;
-	} 
+	return 0xFF000000 | (blueRed & 0xFF00FF) | (green & 0x00FF00);
+}
+
+// append a wall from (0, 0) to (0, 0) to a sector of an unpublished version
+void newWall(struct level *level, size_t id) {
+	editWalls(level, id, level->sectors.arr[id]->numwalls + 1); // new walls are zeroed
 }
 
 // you can't delete a sector because we don't want to change the ids of every other 
 //	sector, since that would cause existing portals to break---instead you should 
 //	delete all the walls in a sector or remove it from the level file
 
-void deleteWall(struct sector *sector, int index) {
-	if (sector->numwalls > 0) {
-		if (sector->numwalls > 1) {
-			// shift everything to the left, erasing the wall at the given index
-			//	only required if the sector has two or more walls
-			for (size_t i = index; i < sector->numwalls - 2; i++) {
-				sector->walls[i] = sector->walls[i + 1];
-			}
+void deleteWall(struct level *level, size_t id, size_t index) {
+	const uint32_t numwalls = level->sectors.arr[id]->numwalls;
+	struct wall *walls;
+
+	if (numwalls > 0 && (walls = editWalls(level, id, numwalls))) {
+		// shift everything after the given index to the left, erasing it
+		for (size_t i = index; i + 1 < numwalls; i++) {
+			walls[i] = walls[i + 1];
 		}
 
 		// decrement the size by one
-		sector->numwalls--;
+		editWalls(level, id, numwalls - 1);
 	}
 }
 
 void vertline(int x, int yStart, int yEnd, uint32_t color) {
 	// set an entire vertical line of pixels to the given color
 	for (int y = yStart; y <= yEnd; y++) {
-		int i = (y * SCREEN_WIDTH) + x;
+		int i = (y * state.frame->pitch) + x;
 
 		// force a crash before writing outside array bounds
-		assert(i >= 0 && i < SCREEN_WIDTH * SCREEN_HEIGHT * 4);
+		assert(i >= 0 && i < state.frame->pitch * state.frame->height);
 
 		if (state.effects) {
 			// intentionally overflow red channel of color for cool results
@@ -403,7 +397,7 @@ void vertline(int x, int yStart, int yEnd, uint32_t color) {
 			 + (uint32_t) state.camera.pos.y + 166) / (yEnd+1 - yStart);
 		}
 
-		state.pixels[i] = color;
+		state.frame->pixels[i] = color;
 	}
 }
 
@@ -412,8 +406,9 @@ void present(void) {
 	int pitch;
 
 	SDL_LockTexture(state.texture, NULL, &px, &pitch); // replace UpdateTexture
-	for (size_t y = 0; y < SCREEN_HEIGHT; y++) {
-		memcpy(&((uint8_t*) px)[y * pitch], &state.pixels[y * SCREEN_WIDTH], SCREEN_WIDTH * 4);
+	for (int y = 0; y < state.frame->height; y++) {
+		memcpy(&((uint8_t*) px)[y * pitch], &state.frame->pixels[y * state.frame->pitch],
+			state.frame->width * 4);
 	}
 	SDL_UnlockTexture(state.texture);
 
@@ -428,7 +423,133 @@ void present(void) {
 	SDL_RenderPresent(state.renderer);
 }
 
-void render(void) {
+// did any of the lines drawn in a column with a portal (see render()) cover
+//	row y? lo and hi are the column's visible range before the portal
+bool portalColumnCovers(int y, int lo, int hi, int yf, int yc, int nyf, int nyc) {
+	return (yf > lo && lo <= y && y <= yf) // floor
+		|| (yc < hi && yc <= y && y <= hi) // ceiling
+		|| (nyc <= y && y <= yc) // step down in the ceiling
+		|| (yf <= y && y <= nyf); // step up in the floor
+}
+
+// make sure render()'s buffers fit a level, returns 0 or -129 if out of memory
+int reserveScratch(const struct level *level) {
+	if (level->sectors.n > state.scratch.sectors) {
+		bool *sectdraw = realloc(state.scratch.sectdraw, level->sectors.n * sizeof(bool));
+		if (!sectdraw) return -129;
+
+		state.scratch.sectdraw = sectdraw;
+		state.scratch.sectors = level->sectors.n;
+	}
+
+	// both endpoints of every wall of the biggest sector
+	const size_t points = 2 * (size_t) level->maxwalls;
+	if (points > state.scratch.points) {
+		// world space x and y, camera space x and y, then vertex indices
+		float *buf = realloc(state.scratch.wx,
+			points * (4 * sizeof(float) + sizeof(uint32_t)));
+		if (!buf) return -129;
+
+		state.scratch.wx = buf;
+		state.scratch.wy = state.scratch.wx + points;
+		state.scratch.cx = state.scratch.wy + points;
+		state.scratch.cy = state.scratch.cx + points;
+		state.scratch.todo = (uint32_t *) (state.scratch.cy + points);
+		state.scratch.points = points;
+	}
+
+	return 0;
+}
+
+// make room for one more sector in the render queue, 0 or -129 if out of memory
+int growQueue(struct render_queue *queue) {
+	const size_t cap = queue->cap ? 2 * queue->cap : 64;
+	struct queue_entry *arr = realloc(queue->arr, cap * sizeof(struct queue_entry));
+	if (!arr) return -129;
+
+	queue->arr = arr;
+	queue->cap = cap;
+	return 0;
+}
+
+// start a new frame of vertex transforms for a level's vertices, which
+//	invalidates all the ones done so far; 0 or -129 if out of memory
+int beginVerts(const struct wall_store *store) {
+	if (store->verts.n > state.verts.cap) {
+		// whatever was grown stays grown, it's only used once cap says so
+		const uint32_t cap = store->verts.n;
+		uint32_t *stamp = realloc(state.verts.stamp, cap * sizeof(uint32_t));
+		if (stamp) state.verts.stamp = stamp;
+		float *x = realloc(state.verts.x, cap * sizeof(float));
+		if (x) state.verts.x = x;
+		float *y = realloc(state.verts.y, cap * sizeof(float));
+		if (y) state.verts.y = y;
+		if (!stamp || !x || !y) return -129;
+
+		memset(&state.verts.stamp[state.verts.cap], 0,
+			(cap - state.verts.cap) * sizeof(uint32_t));
+		state.verts.cap = cap;
+	}
+
+	// stamps are never 0 for a frame, so reset them all when wrapping around
+	if (++state.verts.epoch == 0) {
+		memset(state.verts.stamp, 0, state.verts.cap * sizeof(uint32_t));
+		state.verts.epoch = 1;
+	}
+	return 0;
+}
+
+// make sure the endpoints (vertex indices va, vb) of n walls are in camera
+//	space: the ones that weren't needed yet this frame are gathered and
+//	transformed several at a time
+void transformVerts(const struct wall_store *store,
+	const uint32_t *va, const uint32_t *vb, size_t n) {
+	float
+		*wx = state.scratch.wx, *wy = state.scratch.wy,
+		*cx = state.scratch.cx, *cy = state.scratch.cy;
+	uint32_t *todo = state.scratch.todo;
+	size_t m = 0;
+
+	for (size_t i = 0; i < 2 * n; i++) {
+		const uint32_t v = i < n ? va[i] : vb[i - n];
+		if (state.verts.stamp[v] == state.verts.epoch) continue;
+
+		state.verts.stamp[v] = state.verts.epoch; // so it's only added once
+		wx[m] = store->verts.x[v]; wy[m] = store->verts.y[v];
+		todo[m++] = v;
+	}
+
+	if (m == 0) return; // all done already
+
+	transformPoints(wx, wy, cx, cy, m,
+		state.camera.pos.x, state.camera.pos.y,
+		state.camera.anglecos, state.camera.anglesin);
+
+	for (size_t i = 0; i < m; i++) {
+		state.verts.x[todo[i]] = cx[i];
+		state.verts.y[todo[i]] = cy[i];
+	}
+}
+
+// draw a frame of a level, returns 0 or -129 if out of memory (in which case
+//	parts of the frame might be missing)
+int render(const struct level *level) {
+	// outside of every sector (or in a level without any, or in one that
+	//	isn't paged in) there's nothing to draw from, the whole screen is void
+	if (state.camera.sector == SECTOR_NONE || (size_t) state.camera.sector >= level->sectors.n
+		|| !sectorResident(level, state.camera.sector)) {
+		for (int y = 0; y < SCREEN_HEIGHT; y++) {
+			for (int x = 0; x < SCREEN_WIDTH; x++) {
+				state.frame->pixels[(y * state.frame->pitch) + x] = VOID_COLOR;
+			}
+		}
+		return 0;
+	}
+
+	int retval = reserveScratch(level);
+	if (retval == 0) retval = beginVerts(level->walls);
+	if (retval != 0) return retval;
+
 	// visible ceiling and floor heights across the screen width
 	uint16_t y_lo[SCREEN_WIDTH], y_hi[SCREEN_WIDTH];
 	for (int i = 0; i < SCREEN_WIDTH; i++) {
@@ -436,9 +557,19 @@ void render(void) {
 		y_lo[i] = 0;
 	}
 
+	// everything below y_lo and above y_hi in a column has always been drawn
+	//	already; this keeps track of the rest so that the frame doesn't have to
+	//	be cleared before rendering, only what's left over afterwards
+	uint8_t covered[SCREEN_WIDTH];
+	memset(covered, 0, sizeof(covered));
+
+	// floor and ceiling edges of the wall being drawn, a block of columns at a time
+	enum { SPANS_MAX = 64 };
+	struct { _Alignas(32) int32_t yf[SPANS_MAX], yc[SPANS_MAX], nyf[SPANS_MAX], nyc[SPANS_MAX]; } spans;
+
 	// track which sectors have been drawn
-	bool sectdraw[NUMSECTORS_MAX];
-	memset(sectdraw, 0, sizeof(sectdraw));
+	bool *sectdraw = state.scratch.sectdraw;
+	memset(sectdraw, 0, level->sectors.n * sizeof(bool));
 
 	// calculate edges of near/far planes, looking down positive y axis
 	//	see: https://en.wikipedia.org/wiki/Viewing_frustum
@@ -451,19 +582,16 @@ void render(void) {
 		zfr = (vect2) { zdr.x * ZFAR, zdr.y * ZFAR }; // left and right sides of far plane
 
 
-	// queue of sectors to render
-	enum { QUEUE_MAX = 64 }; // don't render more than 64 sectors
-	struct queue_entry { int id, x0, x1; }; // id of sector and left and right bounds of portal window
+	// always start by rendering the sector the camera is in
+	struct render_queue *queue = &state.scratch.queue;
+	if (queue->cap == 0 && growQueue(queue) != 0) return -129;
 
-	// singleton anonymous struct containing an array of queue_entries and a size
-	struct { struct queue_entry arr[QUEUE_MAX]; size_t n; } queue = {
-		// always start by rendering the sector the camera is in
-		{{ state.camera.sector, 0, SCREEN_WIDTH - 1 }}, 1
-	};
+	queue->arr[0] = (struct queue_entry) { state.camera.sector, 0, SCREEN_WIDTH - 1 };
+	queue->n = 1;
 
-	while (queue.n != 0) {
+	while (queue->n != 0) {
 		// render the end of the queue first
-		struct queue_entry entry = queue.arr[--queue.n];
+		struct queue_entry entry = queue->arr[--queue->n];
 
 		if (sectdraw[entry.id]) {
 			continue; // if we've already rendered this sector, don't do it again
@@ -471,15 +599,29 @@ void render(void) {
 
 		sectdraw[entry.id] = true;
 
-		const struct sector *sector = &state.sectors.arr[entry.id];
+		const struct sector *sector = level->sectors.arr[entry.id];
+		const uint32_t first = level->ranges.first[entry.id];
+		const size_t numwalls = level->ranges.num[entry.id];
+
+		// the sector's walls, streamed from the level's separate arrays
+		const float *ny = &level->walls->edges.ny[first];
+		const int32_t *portals = &level->walls->edges.portal[first];
+		const uint32_t
+			*va = &level->walls->edges.va[first], *vb = &level->walls->edges.vb[first];
 
-		for (size_t i = 0; i < sector->numwalls; i++) {
-			const struct wall *wall = &sector->walls[i];
+		// translate relative to player and rotate points around player's view,
+		//	unless a wall drawn before already had the same endpoint
+		transformVerts(level->walls, va, vb, numwalls);
 
-			// translate relative to player and rotate points around player's view
-			const vect2 
-				op0 = worldPosToCamera(vect2iToVect2(wall->a)),
-				op1 = worldPosToCamera(vect2iToVect2(wall->b));
+		for (size_t i = 0; i < numwalls; i++) {
+			// a portal to a sector that isn't in memory is fog until it's paged in
+			const bool fog = portals[i] && !sectorResident(level, portals[i]);
+			const int portal = fog ? SECTOR_NONE : portals[i];
+
+			// camera space endpoints
+			const vect2
+				op0 = { state.verts.x[va[i]], state.verts.y[va[i]] },
+				op1 = { state.verts.x[vb[i]], state.verts.y[vb[i]] };
 
 			// wall clipped pos (set later)
 			vect2 cp0 = op0, cp1 = op1;
@@ -532,8 +674,9 @@ void render(void) {
 			if (tx0 > entry.x1) continue;
 			if (tx1 < entry.x0) continue;
 
-			// give the illusion of light on walls
-			const int wallshade = 16 * (sin(atan2f(wall->b.x - wall->a.x, wall->b.y - wall->a.y)) + 1.0f);
+			// give the illusion of light on walls, from the baked normal (-ny
+			//	is the sine of the wall's angle)
+			const int wallshade = 16 * (1.0f - ny[i]);
 
 			// clamp to portal boundaries
 			const int
@@ -544,9 +687,9 @@ void render(void) {
 				z_floor = sector->zfloor,
 				z_ceil = sector->zceil,
 				nz_floor = 
-					wall->portal ? state.sectors.arr[wall->portal].zfloor : 0,
+					portal ? level->sectors.arr[portal]->zfloor : 0,
 				nz_ceil = 
-					wall->portal ? state.sectors.arr[wall->portal].zceil : 0;
+					portal ? level->sectors.arr[portal]->zceil : 0;
 
 			const float
 				sy0 = ifnan((VFOV * SCREEN_HEIGHT) / cp0.y, 1e10),
@@ -560,86 +703,318 @@ void render(void) {
 				nyf0 = (SCREEN_HEIGHT / 2) + (int) ((nz_floor - EYE_Z) * sy0),
 				nyc0 = (SCREEN_HEIGHT / 2) + (int) ((nz_ceil  - EYE_Z) * sy0),
 				nyf1 = (SCREEN_HEIGHT / 2) + (int) ((nz_floor - EYE_Z) * sy1),
-				nyc1 = (SCREEN_HEIGHT / 2) + (int) ((nz_ceil  - EYE_Z) * sy1),
-				txd = tx1 - tx0,
-				yfd = yf1 - yf0,
-				ycd = yc1 - yc0,
-				nyfd = nyf1 - nyf0,
-				nycd = nyc1 - nyc0;
-
-			for (int x = x0; x <= x1; x++) {
-				int shade = 255 - wallshade;
-
-				// calculate progress along x axis via tx{0,1} so that walls
-				//	which are partially cut off due to portal edges still have proper heights
-				const float xp = ifnan((x - tx0) / (float) txd, 0);
-
-				// get y ceil and floor for this x ("y=mx+b", yo!)
-				const int
-					tyf = (int) (xp * yfd) + yf0,
-					tyc = (int) (xp * ycd) + yc0,
-					yf = clampi(tyf, y_lo[x], y_hi[x]),
-					yc = clampi(tyc, y_lo[x], y_hi[x]);
-
-				// draw the floor
-				if (yf > y_lo[x]) {
-					vertline(x, y_lo[x], yf, 0xFFFF0000);
-				}
+				nyc1 = (SCREEN_HEIGHT / 2) + (int) ((nz_ceil  - EYE_Z) * sy1);
+
+			// progress along the x axis is calculated via tx{0,1} so that walls
+			//	which are partially cut off due to portal edges still have proper heights
+			const struct wall_edges edges = {
+				.tx0 = tx0, .txd = tx1 - tx0,
+				.yf0 = yf0, .yfd = yf1 - yf0,
+				.yc0 = yc0, .ycd = yc1 - yc0,
+				.nyf0 = nyf0, .nyfd = nyf1 - nyf0,
+				.nyc0 = nyc0, .nycd = nyc1 - nyc0
+			};
+
+			for (int block = x0; block <= x1; block += SPANS_MAX) {
+				const int n = mini(SPANS_MAX, x1 + 1 - block);
+
+				// get y ceil and floor for this block of columns ("y=mx+b", yo!),
+				//	already clamped to what's still visible in each column
+				wallSpans(&edges, block, n, portal, y_lo, y_hi,
+					spans.yf, spans.yc, spans.nyf, spans.nyc);
+
+				for (int j = 0; j < n; j++) {
+					const int x = block + j, yf = spans.yf[j], yc = spans.yc[j];
+					int shade = 255 - wallshade;
+
+					// draw the floor
+					if (yf > y_lo[x]) {
+						vertline(x, y_lo[x], yf, 0xFFFF0000);
+					}
 
-				// draw the ceiling
-				if (yc < y_hi[x]) {
-					vertline(x, yc, y_hi[x], 0xFF00FFFF);
-				}
+					// draw the ceiling
+					if (yc < y_hi[x]) {
+						vertline(x, yc, y_hi[x], 0xFF00FFFF);
+					}
 
-				// draw walls
-				if (wall->portal) {
-					const int
-						tnyf = (int) (xp * nyfd) + nyf0,
-						tnyc = (int) (xp * nycd) + nyc0,
-						nyf = clampi(tnyf, y_lo[x], y_hi[x]),
-						nyc = clampi(tnyc, y_lo[x], y_hi[x]);
-
-					// step down in the ceiling
-					vertline(x, nyc, yc, colorMult(0xFF00FF00, shade));
-					// color the face of the step up in the floor
-					vertline(x, yf, nyf, colorMult(0xFF0000FF, shade));
-
-					y_hi[x] = clampi(mini(mini(yc, nyc), y_hi[x]), 0, SCREEN_HEIGHT - 1);
-					y_lo[x] = clampi(maxi(maxi(yf, nyf), y_lo[x]), 0, SCREEN_HEIGHT - 1);
-				} else {
-					vertline(x, yf, yc, colorMult(0xFFD0D0D0, shade)); // draw normal walls
-				}
+					// draw walls
+					if (portal) {
+						const int
+							nyf = spans.nyf[j], nyc = spans.nyc[j],
+							lo = y_lo[x], hi = y_hi[x];
+
+						// step down in the ceiling
+						vertline(x, nyc, yc, colorMult(0xFF00FF00, shade));
+						// color the face of the step up in the floor
+						vertline(x, yf, nyf, colorMult(0xFF0000FF, shade));
+
+						y_hi[x] = clampi(mini(mini(yc, nyc), y_hi[x]), 0, SCREEN_HEIGHT - 1);
+						y_lo[x] = clampi(maxi(maxi(yf, nyf), y_lo[x]), 0, SCREEN_HEIGHT - 1);
+
+						// the window's new edges are drawn if one of the lines above
+						//	ended on them, or if they didn't move and were drawn before
+						uint8_t c = covered[x];
+						if (y_lo[x] != lo) c &= ~COVERED_LO;
+						if (y_hi[x] != hi) c &= ~COVERED_HI;
+						if (portalColumnCovers(y_lo[x], lo, hi, yf, yc, nyf, nyc)) c |= COVERED_LO;
+						if (portalColumnCovers(y_hi[x], lo, hi, yf, yc, nyf, nyc)) c |= COVERED_HI;
+						if (y_lo[x] > y_hi[x]) c |= COVERED_ALL;
+						covered[x] = c;
+					} else {
+						// draw normal walls
+						vertline(x, yf, yc, fog ? FOG_COLOR : colorMult(0xFFD0D0D0, shade));
+						covered[x] |= COVERED_ALL;
+					}
 
-				// present now to hide the UI and make slomo smooth
-				if (state.slomo) {
-					present();
-					SDL_Delay(6);
+					// present now to hide the UI and make slomo smooth
+					if (state.slomo) {
+						present();
+						SDL_Delay(6);
+					}
 				}
 			}
 
-			if (wall->portal) {
-				assert(queue.n < QUEUE_MAX); // make sure we're not out of queue space
-				queue.arr[queue.n++] = (struct queue_entry) {
-					.id = wall->portal,
+			if (portal) {
+				// without room for it the sector behind the portal isn't drawn
+				if (queue->n == queue->cap && growQueue(queue) != 0) {
+					retval = -129;
+					continue;
+				}
+
+				queue->arr[queue->n++] = (struct queue_entry) {
+					.id = portal,
 					.x0 = x0,
 					.x1 = x1
 				};
 			}
 		}
 	}
+
+	// clear whatever no sector covered, e.g. where there are gaps in the walls
+	if (state.fillUncovered) {
+		for (int x = 0; x < SCREEN_WIDTH; x++) {
+			if (covered[x] & COVERED_ALL) continue;
+
+			const int
+				yStart = y_lo[x] + !!(covered[x] & COVERED_LO),
+				yEnd = y_hi[x] - !!(covered[x] & COVERED_HI);
+			for (int y = yStart; y <= yEnd; y++) {
+				state.frame->pixels[(y * state.frame->pitch) + x] = VOID_COLOR;
+			}
+		}
+	}
+
+	return retval;
+}
+
+// get a reference to the current version of the level, which stays valid
+//	(and unchanged) until it's released, whatever gets published meanwhile
+struct level *acquireLevel(void) {
+	SDL_LockMutex(state.levelLock);
+	struct level *level = retainLevel(state.level);
+	SDL_UnlockMutex(state.levelLock);
+	return level;
+}
+
+// make a new version of the level current, taking over the caller's reference
+void publishLevel(struct level *level) {
+	SDL_LockMutex(state.levelLock);
+	struct level *old = state.level;
+	state.level = level;
+	SDL_UnlockMutex(state.levelLock);
+
+	// anyone still using the old version keeps it alive until they're done
+	releaseLevel(old);
+}
+
+// runs on the loader thread: parse and validate the level without touching
+//	anything the main loop is using, then leave it in 'pending' to be swapped in
+int loaderThread(void *data) {
+	(void) data;
+
+	struct level *level = NULL;
+	int status = loadLevel(state.loader.path, &level);
+
+	// a reload keeps every sector that didn't change, so the new version only
+	//	needs the changed ones copied and baked
+	if (status == 0 && state.loader.reload) {
+		const Uint64 start = SDL_GetPerformanceCounter();
+		struct level *current = acquireLevel();
+		size_t changed;
+		struct level *patched = patchLevel(current, level, &changed);
+		releaseLevel(current);
+		releaseLevel(level);
+
+		level = patched;
+		if (!level) {
+			status = -129; // out of memory
+		} else {
+			fprintf(stderr, "Reloaded %s: %zu sectors changed, patched in %.1f ms\n",
+				state.loader.path, changed, (SDL_GetPerformanceCounter() - start)
+					* 1e3 / SDL_GetPerformanceFrequency());
+
+			if (changed == 0) {
+				releaseLevel(level);
+				level = NULL;
+			}
+		}
+	}
+	SDL_AtomicSet(&state.loader.status, status);
+
+	if (status != 0) {
+		printLoadError(status);
+	} else if (level) {
+		// a level that was loaded earlier but never swapped in is stale now
+		struct level *stale = SDL_AtomicSetPtr(&state.loader.pending, level);
+		if (stale) releaseLevel(stale);
+	}
+
+	SDL_AtomicSet(&state.loader.busy, 0);
+	return status;
+}
+
+// start loading a level in the background, or reloading the one being played;
+//	only one load runs at a time
+void loadLevelAsync(const char *path, bool reload) {
+	if (SDL_AtomicGet(&state.loader.busy)) return;
+
+	// reap the previous (finished) loader thread
+	if (state.loader.thread) {
+		SDL_WaitThread(state.loader.thread, NULL);
+		state.loader.thread = NULL;
+	}
+
+	snprintf(state.loader.path, sizeof(state.loader.path), "%s", path);
+	state.loader.reload = reload;
+	SDL_AtomicSet(&state.loader.busy, 1);
+
+	state.loader.thread = SDL_CreateThread(loaderThread, "level loader", NULL);
+	if (!state.loader.thread) {
+		fprintf(stderr, "Couldn't start level loader thread: %s\n", SDL_GetError());
+		SDL_AtomicSet(&state.loader.busy, 0);
+	}
+}
+
+// save the current version of the level (this runs on the main thread, which
+//	is the only one that publishes versions)
+void saveCurrentLevel(const char *path) {
+	const int status = saveLevel(state.level, path);
+	if (status != 0) {
+		fprintf(stderr, "Error saving level file: %d\n", status);
+	} else {
+		fprintf(stderr, "Saved %zu sectors to %s\n", state.level->sectors.n - 1, path);
+#ifdef __linux__
+		// there's no need to reload what was just saved
+		if (!strcmp(path, state.watch.path)) stat(path, &state.watch.saved);
+#endif
+	}
+}
+
+#ifdef __linux__
+// watch the file at path instead of whatever was watched before. it's the
+//	directory that's watched, since editors (and saveLevel()) often replace a
+//	file by renaming a new one over it
+void watchLevel(const char *path) {
+	if (state.watch.fd < 0) return;
+	if (state.watch.wd >= 0) inotify_rm_watch(state.watch.fd, state.watch.wd);
+
+	snprintf(state.watch.path, sizeof(state.watch.path), "%s", path);
+	char *slash = strrchr(state.watch.path, '/');
+	state.watch.name = slash ? slash + 1 : state.watch.path;
+	state.watch.changed = false;
+	memset(&state.watch.saved, 0, sizeof(state.watch.saved));
+
+	char dir[64];
+	snprintf(dir, sizeof(dir), "%.*s", slash ? (int) (slash - state.watch.path + 1) : 1,
+		slash ? state.watch.path : ".");
+
+	state.watch.wd = inotify_add_watch(state.watch.fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (state.watch.wd < 0) {
+		fprintf(stderr, "Couldn't watch %s for changes\n", dir);
+	}
+}
+
+// reload the level if its file changed since the last frame (and the change
+//	isn't the level being saved from here)
+void checkLevelWatch(void) {
+	if (state.watch.wd < 0) return;
+
+	_Alignas(struct inotify_event) char buf[4096];
+	ssize_t n;
+	while ((n = read(state.watch.fd, buf, sizeof(buf))) > 0) {
+		for (const char *p = buf; p < buf + n; ) {
+			const struct inotify_event *event = (const struct inotify_event *) p;
+			if (event->wd == state.watch.wd && event->len
+				&& !strcmp(event->name, state.watch.name)) {
+				state.watch.changed = true;
+			}
+			p += sizeof(struct inotify_event) + event->len;
+		}
+	}
+
+	if (!state.watch.changed || SDL_AtomicGet(&state.loader.busy)) return;
+	state.watch.changed = false;
+
+	struct stat st;
+	if (stat(state.watch.path, &st) == 0 && st.st_dev == state.watch.saved.st_dev
+		&& st.st_ino == state.watch.saved.st_ino && st.st_size == state.watch.saved.st_size
+		&& st.st_mtim.tv_sec == state.watch.saved.st_mtim.tv_sec
+		&& st.st_mtim.tv_nsec == state.watch.saved.st_mtim.tv_nsec) {
+		return;
+	}
+	loadLevelAsync(state.watch.path, true);
+}
+#else
+void watchLevel(const char *path) { (void) path; }
+void checkLevelWatch(void) {}
+#endif
+
+// swap in a level that finished loading since the last frame, if there is one
+void swapLoadedLevel(void) {
+	struct level *level = SDL_AtomicSetPtr(&state.loader.pending, NULL);
+	if (!level) return;
+
+	publishLevel(level);
+
+	// the player's sector might not exist in the new level, in which case
+	//	it's looked up by position
+	if ((size_t) state.camera.sector >= level->sectors.n) {
+		state.camera.sector = SECTOR_NONE;
+	}
+	if ((size_t) state.sectorBeforeWorldExit >= level->sectors.n) {
+		state.sectorBeforeWorldExit = SECTOR_NONE;
+	}
+
+	printLoaded(level);
+}
+
+// the editor never changes the published level; its edits go into a new
+//	version that's created on the first edit of the frame and published at the end
+struct sector *editorSector(struct level **draft, size_t id) {
+	if (!*draft) *draft = forkLevel(state.level);
+	return *draft ? editSector(*draft, id) : NULL;
+}
+
+// the same for a sector's walls, which keep their number
+struct wall *editorWalls(struct level **draft, size_t id) {
+	if (!*draft) *draft = forkLevel(state.level);
+	return *draft ? editWalls(*draft, id, (*draft)->sectors.arr[id]->numwalls) : NULL;
 }
 
 void renderGUI(void) {
+	struct level *draft = NULL;
+
 	nk_flags window_flags = NK_WINDOW_BORDER|NK_WINDOW_MOVABLE|NK_WINDOW_SCALABLE|
 		NK_WINDOW_MINIMIZABLE|NK_WINDOW_TITLE;
 
 	// main debug window
-	if (nk_begin(state.ctx, "debug", nk_rect(50, 50, 230, 250), window_flags)) {
+	if (nk_begin(state.ctx, "debug", nk_rect(50, 50, 230, 300), window_flags)) {
 		// general info about player position
 		char coords[128];
 		char sector[64];
 		char facing[128];
 		char cos_sin[128];
+		char aim[128];
 
 		snprintf(coords, 128, "x, y: %f, %f", state.camera.pos.x, state.camera.pos.y);
 		snprintf(cos_sin, 128, "cos, sin: %f, %f", 
@@ -648,21 +1023,61 @@ void renderGUI(void) {
 			state.camera.angle, normalizeAngle(state.camera.angle));
 		snprintf(sector, 64, "sector: %d", state.camera.sector);
 
+		// what's straight ahead, found the way anything else would ask
+		const struct ray ray = {
+			state.camera.pos, { state.camera.anglecos, state.camera.anglesin },
+			ZFAR, state.camera.sector
+		};
+		struct ray_hit hit;
+		if (castRay(state.level, &ray, &hit)) {
+			snprintf(aim, 128, "aiming at: sector %d wall %u (%.2f)",
+				hit.sector, hit.wall, hit.distance);
+		} else {
+			snprintf(aim, 128, "aiming at: nothing");
+		}
+
 		nk_layout_row_dynamic(state.ctx, 20, 1);
 		nk_label(state.ctx, coords, NK_TEXT_LEFT);
 		nk_label(state.ctx, cos_sin, NK_TEXT_LEFT);
 		nk_label(state.ctx, facing, NK_TEXT_LEFT);
 		nk_label(state.ctx, sector, NK_TEXT_LEFT);
+		nk_label(state.ctx, aim, NK_TEXT_LEFT);
 
 		nk_checkbox_label(state.ctx, "show map editor", &state.editorOpen);
 		nk_checkbox_label(state.ctx, "print sector BFS errors to console", &state.displayErrors);
 		nk_checkbox_label(state.ctx, "slow motion", &state.slomo);
 		nk_checkbox_label(state.ctx, "visual effects", &state.effects);
 		nk_checkbox_label(state.ctx, "noclip", &state.noclip);
+		nk_checkbox_label(state.ctx, "only clear undrawn pixels", &state.fillUncovered);
+		nk_property_int(state.ctx, "#page budget (MB)", 1, &state.pageBudget, 1 << 16, 1, 1);
+
+		// switch instruction sets to compare them (scalar is the reference)
+		const int simd = nk_combo(state.ctx, simdPathNames, SIMD_PATHS,
+			state.simd, 20, nk_vec2(200, 100));
+		if (simd != state.simd) {
+			state.simd = simdUse(simd);
+		}
 		if (nk_button_label(state.ctx, "teleport to (2, 2)")) {
 			state.camera.pos = (vect2) { 2.0, 2.0 };
 		}
-		
+
+		// load a different level (or reload this one) without stopping
+		nk_edit_string(state.ctx, NK_EDIT_FIELD, state.editorFilepath,
+			&state.filepathLength, sizeof(state.editorFilepath) - 1, nk_filter_default);
+		if (SDL_AtomicGet(&state.loader.busy)) {
+			nk_label(state.ctx, "loading...", NK_TEXT_LEFT);
+		} else if (nk_button_label(state.ctx, "load level")) {
+			state.editorFilepath[state.filepathLength] = '\0';
+			loadLevelAsync(state.editorFilepath, false);
+			watchLevel(state.editorFilepath);
+		}
+
+		// write the level as it is now, edits included, to the same path; the
+		//	format goes by the extension like it does for raycast-convert
+		if (nk_button_label(state.ctx, "save level")) {
+			state.editorFilepath[state.filepathLength] = '\0';
+			saveCurrentLevel(state.editorFilepath);
+		}
 	}
 	nk_end(state.ctx); 
 
@@ -673,62 +1088,99 @@ void renderGUI(void) {
 			char sectors[64];
 
 			// sectors start at 1, walls start at 0
-			snprintf(sectors, 64, "sectors: %zu/%d", state.sectors.n - 1, NUMSECTORS_MAX);
+			snprintf(sectors, 64, "sectors: %zu", state.level->sectors.n - 1);
 
 			nk_layout_row_dynamic(state.ctx, 20, 1);
 			nk_label(state.ctx, sectors, NK_TEXT_CENTERED);
 
-			for (size_t i = 0; i < state.sectors.n - 1; i++) {
-				struct sector *sector = &state.sectors.arr[i + 1];
+			for (size_t i = 0; i < state.level->sectors.n - 1; i++) {
+				const struct sector *sector = state.level->sectors.arr[i + 1];
+				struct sector *edit;
 
 				char sectorName[128];
-				snprintf(sectorName, 128, "sector %zu, %ld walls (%d max)",
-					i + 1, sector->numwalls, NUMWALLS_MAX);
+				snprintf(sectorName, 128, "sector %zu, %u walls",
+					i + 1, sector->numwalls);
 
 				nk_layout_row_dynamic(state.ctx, 20, 1);
 				if (nk_tree_push(state.ctx, NK_TREE_TAB, sectorName, NK_MAXIMIZED)) {
+					// widgets edit local copies, which are written to the new
+					//	version only if they actually changed
+					float zfloor = sector->zfloor, zceil = sector->zceil;
+
 					nk_layout_row_dynamic(state.ctx, 20, 2);
-					nk_property_float(state.ctx, "#zfloor", 0.0f, &sector->zfloor, EYE_Z, 0.1f, 0.1f);
-					nk_property_float(state.ctx, "#zceil", EYE_Z, &sector->zceil, ZFAR, 0.1f, 0.1f);
+					nk_property_float(state.ctx, "#zfloor", 0.0f, &zfloor, EYE_Z, 0.1f, 0.1f);
+					nk_property_float(state.ctx, "#zceil", EYE_Z, &zceil, ZFAR, 0.1f, 0.1f);
+
+					if (memcmp(&zfloor, &sector->zfloor, sizeof(float))
+						&& (edit = editorSector(&draft, i + 1))) {
+						edit->zfloor = zfloor;
+					}
+					if (memcmp(&zceil, &sector->zceil, sizeof(float))
+						&& (edit = editorSector(&draft, i + 1))) {
+						edit->zceil = zceil;
+					}
 
+					const struct wall *walls = sectorWalls(state.level, sector);
 					for (size_t j = 0; j < sector->numwalls; j++) {
 						char wallName[64];
 						snprintf(wallName, 64, "wall %zu", j);
 
-						struct wall *wall = &sector->walls[j];
+						struct wall wall = walls[j], *edits;
 
 						nk_layout_row_dynamic(state.ctx, 20, 1);
 						nk_label(state.ctx, wallName, NK_TEXT_LEFT);
 						nk_layout_row_dynamic(state.ctx, 20, 2);
-						nk_property_int(state.ctx, "#a.x", 0, &wall->a.x, (int) ZFAR, 1, 1);
-						nk_property_int(state.ctx, "#a.y", 0, &wall->a.y, (int) ZFAR, 1, 1);
-						nk_property_int(state.ctx, "#b.x", 0, &wall->b.x, (int) ZFAR, 1, 1);
-						nk_property_int(state.ctx, "#b.y", 0, &wall->b.y, (int) ZFAR, 1, 1);
+						nk_property_int(state.ctx, "#a.x", 0, &wall.a.x, (int) ZFAR, 1, 1);
+						nk_property_int(state.ctx, "#a.y", 0, &wall.a.y, (int) ZFAR, 1, 1);
+						nk_property_int(state.ctx, "#b.x", 0, &wall.b.x, (int) ZFAR, 1, 1);
+						nk_property_int(state.ctx, "#b.y", 0, &wall.b.y, (int) ZFAR, 1, 1);
 						nk_property_int(state.ctx, "#portal to", 0,
-							&wall->portal, state.sectors.n - 1, 1, 1);
-						if (nk_button_label(state.ctx, "delete wall")) {
-							deleteWall(sector, j);
+							&wall.portal, state.level->sectors.n - 1, 1, 1);
+
+						if (memcmp(&wall, &walls[j], sizeof(struct wall))
+							&& (edits = editorWalls(&draft, i + 1))) {
+							edits[j] = wall;
+						}
+
+						if (nk_button_label(state.ctx, "delete wall")
+							&& (draft || (draft = forkLevel(state.level)))) {
+							deleteWall(draft, i + 1, j);
 						}
 					}
 					nk_layout_row_dynamic(state.ctx, 20, 2);
-					if (nk_button_label(state.ctx, "new wall")) {
-						newWall(sector);
+					if (nk_button_label(state.ctx, "new wall")
+						&& (draft || (draft = forkLevel(state.level)))) {
+						newWall(draft, i + 1);
 					}
 					nk_tree_pop(state.ctx);
 				}
 			}
 			if (nk_button_label(state.ctx, "new sector")) {
-				newSector();
+				if (!draft) draft = forkLevel(state.level);
+				if (draft) newSector(draft);
 			}
 		}
 		nk_end(state.ctx);
 	}
+
+	// everything edited this frame becomes visible at once, starting with the
+	//	next frame that's rendered
+	if (draft) {
+		const int status = bakeLevel(draft);
+		if (status == 0) {
+			publishLevel(draft);
+		} else {
+			fprintf(stderr, "Error baking edits, they're dropped: %d\n", status);
+			releaseLevel(draft);
+		}
+	}
 }
 
 int main(int argc, char* argv[]) {
 	printf("Starting " PROJECT_NAME "... \n");
 
-	state.pixels = malloc(SCREEN_WIDTH * SCREEN_HEIGHT * 4);
+	state.frame = acquireFramebuffer(SCREEN_WIDTH, SCREEN_HEIGHT);
+	assert(state.frame);
 
 	assert(SDL_Init(SDL_INIT_VIDEO) == 0);
 
@@ -745,25 +1197,44 @@ int main(int argc, char* argv[]) {
 		SDL_TEXTUREACCESS_STREAMING, SCREEN_WIDTH, SCREEN_HEIGHT);
 	assert(state.texture);
 
+	state.simd = simdInit();
+	fprintf(stderr, "Using %s rendering paths\n", simdPathNames[state.simd]);
+
+	state.levelLock = SDL_CreateMutex();
+	assert(state.levelLock);
+
+	state.watch.wd = -1;
+#ifdef __linux__
+	state.watch.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#else
+	state.watch.fd = -1;
+#endif
+
 	state.camera.pos = (vect2) { 2, 2 };
 	state.camera.angle = 0.0;
 	state.camera.sector = 0;
 
 	state.positionBeforeWorldExit = state.camera.pos;
-	state.sectorBeforeWorldExit = 1;
+	state.sectorBeforeWorldExit = SECTOR_NONE;
 
 	if (argc == 2) {
-		int status = loadSectors(argv[1]);
+		// the first level is loaded up front; later ones go through the loader thread
+		int status = loadLevel(argv[1], &state.level);
 		if (status != 0) {
-			fprintf(stderr, "Error loading level file: %d\n", status);
+			printLoadError(status);
 			goto exit;
 		}
+
+		state.filepathLength = snprintf(state.editorFilepath,
+			sizeof(state.editorFilepath), "%s", argv[1]);
+		state.filepathLength = mini(state.filepathLength, sizeof(state.editorFilepath) - 1);
+		watchLevel(argv[1]);
 	} else {
 		fprintf(stderr, "Usage: %s [level file]\n", argv[0]);
 		goto exit;
 	}
 
-	fprintf(stderr, "Loaded %zu sectors\n", state.sectors.n - 1);
+	printLoaded(state.level);
 
 	// set up GUI
 	state.ctx = nk_sdl_init(state.window, state.renderer);
@@ -798,6 +1269,8 @@ int main(int argc, char* argv[]) {
 	state.slomo = false;
 	state.effects = true;
 	state.noclip = false;
+	state.fillUncovered = true;
+	state.pageBudget = LEVEL_PAGE_BUDGET;
 
 	state.quit = false;
 	while (!state.quit) {
@@ -812,8 +1285,16 @@ int main(int argc, char* argv[]) {
 		}
 
 		nk_input_end(state.ctx);
+
+		// the only point in the frame where the level may be replaced
+		checkLevelWatch();
+		swapLoadedLevel();
+
 		renderGUI();
 
+		// everything from here on reads this version, even if a newer one is published
+		struct level *level = acquireLevel();
+
 		const float rotspeed = 3.0f * 0.016f;
 		const float movespeed = 3.0f * 0.016f;
 
@@ -829,53 +1310,34 @@ int main(int argc, char* argv[]) {
 		state.camera.anglecos = cos(state.camera.angle);
 		state.camera.anglesin = sin(state.camera.angle);
 
+		vect2 move = { 0.0f, 0.0f };
 		if (keystate[SDLK_UP & 0xFFFF]) {
-			state.camera.pos.x += movespeed * state.camera.anglecos;
-			state.camera.pos.y += movespeed * state.camera.anglesin;
+			move.x += movespeed * state.camera.anglecos;
+			move.y += movespeed * state.camera.anglesin;
 		}
 
 		if (keystate[SDLK_DOWN & 0xFFFF]) {
-			state.camera.pos.x -= movespeed * state.camera.anglecos;
-			state.camera.pos.y -= movespeed * state.camera.anglesin;
+			move.x -= movespeed * state.camera.anglecos;
+			move.y -= movespeed * state.camera.anglesin;
+		}
+
+		if (state.noclip) {
+			state.camera.pos.x += move.x;
+			state.camera.pos.y += move.y;
+		} else {
+			state.camera.pos = collideMove(level, state.camera.sector,
+				state.camera.pos, move, PLAYER_RADIUS, &state.scratch.blockers);
 		}
 
 		bool outsideWorld = false;
 
-		// update player's sector
+		// update player's sector by following them from the last place they
+		//	were in the world, and look it up if they didn't get there through
+		//	portals (teleporting, say, or walking through a wall)
 		{
-			// BFS neighbors in a circular queue because player is likely to be in a neighboring sector
-			enum { QUEUE_MAX = 64 };
-			int queue[QUEUE_MAX] = { state.camera.sector };
-			int i = 0, n = 1, found = SECTOR_NONE;
-
-			while (n != 0) {
-				// get front of queue and advance to next
-				const int id = queue[i];
-				i = (i + 1) % QUEUE_MAX; // wrap around
-				n--;
-
-				const struct sector *sector = &state.sectors.arr[id];
-
-				if (pointInSector(sector, state.camera.pos)) {
-					found = id;
-					break;
-				}
-
-				// check neighbors
-				for (size_t j = 0; j < sector->numwalls; j++) {
-					const struct wall *wall = &sector->walls[j];
-
-					if (wall->portal) {
-						if (n == QUEUE_MAX) {
-							if (state.displayErrors) fprintf(stderr, "out of queue space in sector BFS\n");
-							goto done;
-						}
-						queue [(i + n) % QUEUE_MAX] = wall->portal;
-						n++;
-					}
-				}
-			}
-done:
+			int found = traceSector(level, state.sectorBeforeWorldExit,
+				state.positionBeforeWorldExit, state.camera.pos);
+			if (!found) found = findSector(level, state.camera.sector, state.camera.pos);
 			if (!found) {
 				if (state.displayErrors) fprintf(stderr, "player is not in a sector\n");
 				outsideWorld = true;
@@ -896,15 +1358,32 @@ done:
 			state.sectorBeforeWorldExit = state.camera.sector;
 		}
 
-		// clear existing pixel array and render to it
-		memset(state.pixels, 0, SCREEN_WIDTH * SCREEN_HEIGHT * 4);
-		render();
+		// keep what's near the player in memory for the next frames
+		pageLevel(level, state.camera.sector, (size_t) state.pageBudget << 20);
+
+		// clear existing pixel array and render to it, unless the renderer is
+		//	clearing just what it doesn't draw over (slow motion shows the frame
+		//	while it's being drawn, which should start out empty)
+		if (!state.fillUncovered || state.slomo) {
+			memset(state.frame->pixels, 0, state.frame->size);
+		}
+		const int status = render(level);
+		if (status != 0 && state.displayErrors) fprintf(stderr, "error rendering frame: %d\n", status);
+		releaseLevel(level);
 
 		if (!state.slomo) present();
 		else state.slomo = false; // only one frame 
 	}
 
 exit:
+	if (state.loader.thread) SDL_WaitThread(state.loader.thread, NULL);
+#ifdef __linux__
+	if (state.watch.fd >= 0) close(state.watch.fd);
+#endif
+
+	releaseFramebuffer(state.frame);
+	drainFramebuffers();
+
 	SDL_DestroyTexture(state.texture);
 	SDL_DestroyRenderer(state.renderer);
 	SDL_DestroyWindow(state.window);
@@ -0,0 +1,394 @@
+#include <math.h>
+#include <stddef.h>
+
+#include "simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#else
+#define SIMD_X86 0
+#endif
+
+const char *simdPathNames[SIMD_PATHS] = { "scalar", "sse2", "avx2" };
+
+// scalar versions, these define what the vectorized versions have to compute
+
+// same math as translating and rotating one point at a time
+static void transformPointsScalar(
+	const float *x, const float *y, float *outx, float *outy, size_t n,
+	float camx, float camy, float anglecos, float anglesin) {
+	for (size_t i = 0; i < n; i++) {
+		const float ux = x[i] - camx, uy = y[i] - camy;
+		outx[i] = ux * anglesin - uy * anglecos;
+		outy[i] = ux * anglecos + uy * anglesin;
+	}
+}
+
+// outside as soon as the point is on the right of an edge, i.e. pointSide() > 0
+static bool pointInEdgesScalar(
+	const float *vx, const float *vy, const uint32_t *va, const uint32_t *vb, size_t n,
+	float px, float py) {
+	for (size_t i = 0; i < n; i++) {
+		const float ax = vx[va[i]], ay = vy[va[i]], bx = vx[vb[i]], by = vy[vb[i]];
+		if ((px - ax) * (by - ay) - (py - ay) * (bx - ax) < 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void pointsInEdgesScalar(
+	const float *vx, const float *vy, const uint32_t *va, const uint32_t *vb, size_t n,
+	const float *px, const float *py, size_t npoints, bool *inside) {
+	for (size_t j = 0; j < npoints; j++) {
+		inside[j] = pointInEdgesScalar(vx, vy, va, vb, n, px[j], py[j]);
+	}
+}
+
+static int clamp(int v, int lo, int hi) {
+	v = v > lo ? v : lo;
+	return v < hi ? v : hi;
+}
+
+// progress along the wall is (x - tx0) / txd, 0 where that's NaN (txd == 0)
+static void wallSpansScalar(
+	const struct wall_edges *e, int x, int n, bool portal,
+	const uint16_t *ylo, const uint16_t *yhi,
+	int32_t *yf, int32_t *yc, int32_t *nyf, int32_t *nyc) {
+	for (int i = 0; i < n; i++, x++) {
+		float xp = (x - e->tx0) / (float) e->txd;
+		if (isnan(xp)) xp = 0;
+
+		yf[i] = clamp((int) (xp * e->yfd) + e->yf0, ylo[x], yhi[x]);
+		yc[i] = clamp((int) (xp * e->ycd) + e->yc0, ylo[x], yhi[x]);
+
+		if (portal) {
+			nyf[i] = clamp((int) (xp * e->nyfd) + e->nyf0, ylo[x], yhi[x]);
+			nyc[i] = clamp((int) (xp * e->nycd) + e->nyc0, ylo[x], yhi[x]);
+		}
+	}
+}
+
+#if SIMD_X86
+// the compiler is told per function which instruction set it may use, so the
+//	file builds without -mavx2 and only runs AVX2 code on CPUs that have it;
+//	FMA is deliberately left out so results stay identical to the scalar path
+
+__attribute__((target("sse2")))
+static void transformPointsSSE2(
+	const float *x, const float *y, float *outx, float *outy, size_t n,
+	float camx, float camy, float anglecos, float anglesin) {
+	const __m128
+		cx = _mm_set1_ps(camx), cy = _mm_set1_ps(camy),
+		c = _mm_set1_ps(anglecos), s = _mm_set1_ps(anglesin);
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		const __m128
+			ux = _mm_sub_ps(_mm_loadu_ps(&x[i]), cx),
+			uy = _mm_sub_ps(_mm_loadu_ps(&y[i]), cy);
+		_mm_storeu_ps(&outx[i], _mm_sub_ps(_mm_mul_ps(ux, s), _mm_mul_ps(uy, c)));
+		_mm_storeu_ps(&outy[i], _mm_add_ps(_mm_mul_ps(ux, c), _mm_mul_ps(uy, s)));
+	}
+
+	transformPointsScalar(&x[i], &y[i], &outx[i], &outy[i], n - i,
+		camx, camy, anglecos, anglesin);
+}
+
+// cross product of each edge with the vector from its start to the point,
+//	negative where the point is on the right of the edge
+__attribute__((target("sse2")))
+static inline __m128 sideSSE2(__m128 x, __m128 y, __m128 ax, __m128 ay, __m128 bx, __m128 by) {
+	return _mm_sub_ps(
+		_mm_mul_ps(_mm_sub_ps(x, ax), _mm_sub_ps(by, ay)),
+		_mm_mul_ps(_mm_sub_ps(y, ay), _mm_sub_ps(bx, ax)));
+}
+
+// four of the vertices v[i] (SSE2 has no gathers)
+__attribute__((target("sse2")))
+static inline __m128 gatherSSE2(const float *v, const uint32_t *i) {
+	return _mm_setr_ps(v[i[0]], v[i[1]], v[i[2]], v[i[3]]);
+}
+
+// one point against four edges at a time
+__attribute__((target("sse2")))
+static bool pointInEdgesSSE2(
+	const float *vx, const float *vy, const uint32_t *va, const uint32_t *vb, size_t n,
+	float px, float py) {
+	const __m128 x = _mm_set1_ps(px), y = _mm_set1_ps(py), zero = _mm_setzero_ps();
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		const __m128 t = sideSSE2(x, y,
+			gatherSSE2(vx, &va[i]), gatherSSE2(vy, &va[i]),
+			gatherSSE2(vx, &vb[i]), gatherSSE2(vy, &vb[i]));
+		if (_mm_movemask_ps(_mm_cmplt_ps(t, zero))) return false;
+	}
+
+	return pointInEdgesScalar(vx, vy, &va[i], &vb[i], n - i, px, py);
+}
+
+// four points against one edge at a time
+__attribute__((target("sse2")))
+static void pointsInEdgesSSE2(
+	const float *vx, const float *vy, const uint32_t *va, const uint32_t *vb, size_t n,
+	const float *px, const float *py, size_t npoints, bool *inside) {
+	const __m128 zero = _mm_setzero_ps();
+
+	size_t j = 0;
+	for (; j + 4 <= npoints; j += 4) {
+		const __m128 x = _mm_loadu_ps(&px[j]), y = _mm_loadu_ps(&py[j]);
+		__m128 outside = zero;
+
+		for (size_t i = 0; i < n; i++) {
+			const __m128 t = sideSSE2(x, y,
+				_mm_set1_ps(vx[va[i]]), _mm_set1_ps(vy[va[i]]),
+				_mm_set1_ps(vx[vb[i]]), _mm_set1_ps(vy[vb[i]]));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(t, zero));
+			if (_mm_movemask_ps(outside) == 0xF) break;
+		}
+
+		const int mask = _mm_movemask_ps(outside);
+		for (int k = 0; k < 4; k++) {
+			inside[j + k] = !(mask & (1 << k));
+		}
+	}
+
+	pointsInEdgesScalar(vx, vy, va, vb, n, &px[j], &py[j], npoints - j, &inside[j]);
+}
+
+// SSE2 has no 32-bit integer min/max, so select with a comparison instead
+__attribute__((target("sse2")))
+static inline __m128i clampSSE2(__m128i v, __m128i lo, __m128i hi) {
+	__m128i m = _mm_cmpgt_epi32(v, lo);
+	v = _mm_or_si128(_mm_and_si128(m, v), _mm_andnot_si128(m, lo));
+	m = _mm_cmplt_epi32(v, hi);
+	return _mm_or_si128(_mm_and_si128(m, v), _mm_andnot_si128(m, hi));
+}
+
+// (int) (xp * d) + y0 for four columns, cvttps truncates like a C cast does
+__attribute__((target("sse2")))
+static inline __m128i edgeSSE2(__m128 xp, int d, int y0) {
+	return _mm_add_epi32(
+		_mm_cvttps_epi32(_mm_mul_ps(xp, _mm_set1_ps((float) d))),
+		_mm_set1_epi32(y0));
+}
+
+__attribute__((target("sse2")))
+static void wallSpansSSE2(
+	const struct wall_edges *e, int x, int n, bool portal,
+	const uint16_t *ylo, const uint16_t *yhi,
+	int32_t *yf, int32_t *yc, int32_t *nyf, int32_t *nyc) {
+	const __m128 txd = _mm_set1_ps((float) e->txd);
+	const __m128i step = _mm_set_epi32(3, 2, 1, 0), zero = _mm_setzero_si128();
+
+	int i = 0;
+	for (; i + 4 <= n; i += 4, x += 4) {
+		__m128 xp = _mm_div_ps(
+			_mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(x - e->tx0), step)), txd);
+		xp = _mm_andnot_ps(_mm_cmpunord_ps(xp, xp), xp); // NaN -> 0
+
+		const __m128i
+			lo = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *) &ylo[x]), zero),
+			hi = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *) &yhi[x]), zero);
+
+		_mm_storeu_si128((__m128i *) &yf[i], clampSSE2(edgeSSE2(xp, e->yfd, e->yf0), lo, hi));
+		_mm_storeu_si128((__m128i *) &yc[i], clampSSE2(edgeSSE2(xp, e->ycd, e->yc0), lo, hi));
+
+		if (portal) {
+			_mm_storeu_si128((__m128i *) &nyf[i],
+				clampSSE2(edgeSSE2(xp, e->nyfd, e->nyf0), lo, hi));
+			_mm_storeu_si128((__m128i *) &nyc[i],
+				clampSSE2(edgeSSE2(xp, e->nycd, e->nyc0), lo, hi));
+		}
+	}
+
+	wallSpansScalar(e, x, n - i, portal, ylo, yhi, &yf[i], &yc[i], &nyf[i], &nyc[i]);
+}
+
+__attribute__((target("avx2")))
+static void transformPointsAVX2(
+	const float *x, const float *y, float *outx, float *outy, size_t n,
+	float camx, float camy, float anglecos, float anglesin) {
+	const __m256
+		cx = _mm256_set1_ps(camx), cy = _mm256_set1_ps(camy),
+		c = _mm256_set1_ps(anglecos), s = _mm256_set1_ps(anglesin);
+
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		const __m256
+			ux = _mm256_sub_ps(_mm256_loadu_ps(&x[i]), cx),
+			uy = _mm256_sub_ps(_mm256_loadu_ps(&y[i]), cy);
+		_mm256_storeu_ps(&outx[i],
+			_mm256_sub_ps(_mm256_mul_ps(ux, s), _mm256_mul_ps(uy, c)));
+		_mm256_storeu_ps(&outy[i],
+			_mm256_add_ps(_mm256_mul_ps(ux, c), _mm256_mul_ps(uy, s)));
+	}
+
+	transformPointsSSE2(&x[i], &y[i], &outx[i], &outy[i], n - i,
+		camx, camy, anglecos, anglesin);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 sideAVX2(__m256 x, __m256 y, __m256 ax, __m256 ay, __m256 bx, __m256 by) {
+	return _mm256_sub_ps(
+		_mm256_mul_ps(_mm256_sub_ps(x, ax), _mm256_sub_ps(by, ay)),
+		_mm256_mul_ps(_mm256_sub_ps(y, ay), _mm256_sub_ps(bx, ax)));
+}
+
+// vertex indices are below INT32_MAX (see level.h), so they work as the
+//	gathers' signed indices
+__attribute__((target("avx2")))
+static bool pointInEdgesAVX2(
+	const float *vx, const float *vy, const uint32_t *va, const uint32_t *vb, size_t n,
+	float px, float py) {
+	const __m256 x = _mm256_set1_ps(px), y = _mm256_set1_ps(py), zero = _mm256_setzero_ps();
+
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		const __m256i
+			a = _mm256_loadu_si256((const __m256i *) &va[i]),
+			b = _mm256_loadu_si256((const __m256i *) &vb[i]);
+		const __m256 t = sideAVX2(x, y,
+			_mm256_i32gather_ps(vx, a, 4), _mm256_i32gather_ps(vy, a, 4),
+			_mm256_i32gather_ps(vx, b, 4), _mm256_i32gather_ps(vy, b, 4));
+		if (_mm256_movemask_ps(_mm256_cmp_ps(t, zero, _CMP_LT_OQ))) return false;
+	}
+
+	return pointInEdgesSSE2(vx, vy, &va[i], &vb[i], n - i, px, py);
+}
+
+__attribute__((target("avx2")))
+static void pointsInEdgesAVX2(
+	const float *vx, const float *vy, const uint32_t *va, const uint32_t *vb, size_t n,
+	const float *px, const float *py, size_t npoints, bool *inside) {
+	const __m256 zero = _mm256_setzero_ps();
+
+	size_t j = 0;
+	for (; j + 8 <= npoints; j += 8) {
+		const __m256 x = _mm256_loadu_ps(&px[j]), y = _mm256_loadu_ps(&py[j]);
+		__m256 outside = zero;
+
+		for (size_t i = 0; i < n; i++) {
+			const __m256 t = sideAVX2(x, y,
+				_mm256_set1_ps(vx[va[i]]), _mm256_set1_ps(vy[va[i]]),
+				_mm256_set1_ps(vx[vb[i]]), _mm256_set1_ps(vy[vb[i]]));
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(t, zero, _CMP_LT_OQ));
+			if (_mm256_movemask_ps(outside) == 0xFF) break;
+		}
+
+		const int mask = _mm256_movemask_ps(outside);
+		for (int k = 0; k < 8; k++) {
+			inside[j + k] = !(mask & (1 << k));
+		}
+	}
+
+	pointsInEdgesSSE2(vx, vy, va, vb, n, &px[j], &py[j], npoints - j, &inside[j]);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i edgeAVX2(__m256 xp, int d, int y0) {
+	return _mm256_add_epi32(
+		_mm256_cvttps_epi32(_mm256_mul_ps(xp, _mm256_set1_ps((float) d))),
+		_mm256_set1_epi32(y0));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i clampAVX2(__m256i v, __m256i lo, __m256i hi) {
+	return _mm256_min_epi32(_mm256_max_epi32(v, lo), hi);
+}
+
+__attribute__((target("avx2")))
+static void wallSpansAVX2(
+	const struct wall_edges *e, int x, int n, bool portal,
+	const uint16_t *ylo, const uint16_t *yhi,
+	int32_t *yf, int32_t *yc, int32_t *nyf, int32_t *nyc) {
+	const __m256 txd = _mm256_set1_ps((float) e->txd);
+	const __m256i step = _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+
+	int i = 0;
+	for (; i + 8 <= n; i += 8, x += 8) {
+		__m256 xp = _mm256_div_ps(
+			_mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(x - e->tx0), step)), txd);
+		xp = _mm256_andnot_ps(_mm256_cmp_ps(xp, xp, _CMP_UNORD_Q), xp); // NaN -> 0
+
+		const __m256i
+			lo = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) &ylo[x])),
+			hi = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) &yhi[x]));
+
+		_mm256_storeu_si256((__m256i *) &yf[i], clampAVX2(edgeAVX2(xp, e->yfd, e->yf0), lo, hi));
+		_mm256_storeu_si256((__m256i *) &yc[i], clampAVX2(edgeAVX2(xp, e->ycd, e->yc0), lo, hi));
+
+		if (portal) {
+			_mm256_storeu_si256((__m256i *) &nyf[i],
+				clampAVX2(edgeAVX2(xp, e->nyfd, e->nyf0), lo, hi));
+			_mm256_storeu_si256((__m256i *) &nyc[i],
+				clampAVX2(edgeAVX2(xp, e->nycd, e->nyc0), lo, hi));
+		}
+	}
+
+	wallSpansSSE2(e, x, n - i, portal, ylo, yhi, &yf[i], &yc[i], &nyf[i], &nyc[i]);
+}
+#endif
+
+void (*transformPoints)(
+	const float *x, const float *y, float *outx, float *outy, size_t n,
+	float camx, float camy, float anglecos, float anglesin) = transformPointsScalar;
+
+bool (*pointInEdges)(
+	const float *vx, const float *vy, const uint32_t *va, const uint32_t *vb, size_t n,
+	float px, float py) = pointInEdgesScalar;
+
+void (*pointsInEdges)(
+	const float *vx, const float *vy, const uint32_t *va, const uint32_t *vb, size_t n,
+	const float *px, const float *py, size_t npoints, bool *inside) = pointsInEdgesScalar;
+
+void (*wallSpans)(
+	const struct wall_edges *e, int x, int n, bool portal,
+	const uint16_t *ylo, const uint16_t *yhi,
+	int32_t *yf, int32_t *yc, int32_t *nyf, int32_t *nyc) = wallSpansScalar;
+
+// best path the CPU running this supports
+static enum simd_path simdSupported(void) {
+#if SIMD_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+	if (__builtin_cpu_supports("sse2")) return SIMD_SSE2;
+#endif
+	return SIMD_SCALAR;
+}
+
+enum simd_path simdInit(void) {
+	return simdUse(SIMD_PATHS);
+}
+
+enum simd_path simdUse(enum simd_path path) {
+	const enum simd_path supported = simdSupported();
+	if (path > supported) path = supported;
+
+	switch (path) {
+#if SIMD_X86
+	case SIMD_AVX2:
+		transformPoints = transformPointsAVX2;
+		pointInEdges = pointInEdgesAVX2;
+		pointsInEdges = pointsInEdgesAVX2;
+		wallSpans = wallSpansAVX2;
+		break;
+	case SIMD_SSE2:
+		transformPoints = transformPointsSSE2;
+		pointInEdges = pointInEdgesSSE2;
+		pointsInEdges = pointsInEdgesSSE2;
+		wallSpans = wallSpansSSE2;
+		break;
+#endif
+	default:
+		path = SIMD_SCALAR;
+		transformPoints = transformPointsScalar;
+		pointInEdges = pointInEdgesScalar;
+		pointsInEdges = pointsInEdgesScalar;
+		wallSpans = wallSpansScalar;
+		break;
+	}
+	return path;
+}
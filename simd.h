@@ -0,0 +1,61 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// instruction sets the vectorized parts of the renderer can use, the scalar
+//	versions compute exactly the same results and are there to check against
+enum simd_path {
+	SIMD_SCALAR,
+	SIMD_SSE2,
+	SIMD_AVX2,
+	SIMD_PATHS
+};
+
+extern const char *simdPathNames[SIMD_PATHS];
+
+// pick the best path this CPU supports, returns the path in use
+enum simd_path simdInit(void);
+
+// switch to a specific path, falling back to the best one the CPU supports if
+//	it can't run the one asked for; returns the path in use
+enum simd_path simdUse(enum simd_path path);
+
+// translate and rotate n points from world space into camera space (see the
+//	scalar version for the exact math); coordinates are in separate x and y arrays
+extern void (*transformPoints)(
+	const float *x, const float *y, float *outx, float *outy, size_t n,
+	float camx, float camy, float anglecos, float anglesin);
+
+// is the point (px, py) on the left of, or on, all n edges from vertex va[i]
+//	to vertex vb[i]? vertex coordinates are in separate x and y arrays
+extern bool (*pointInEdges)(
+	const float *vx, const float *vy, const uint32_t *va, const uint32_t *vb, size_t n,
+	float px, float py);
+
+// the same test for many points against the same edges, inside[i] is set for
+//	each point (px[i], py[i])
+extern void (*pointsInEdges)(
+	const float *vx, const float *vy, const uint32_t *va, const uint32_t *vb, size_t n,
+	const float *px, const float *py, size_t npoints, bool *inside);
+
+// heights of a wall's floor and ceiling edges (and those of the sector behind
+//	it, if it's a portal) are linear across the screen; these are their values
+//	at the wall's first column tx0 and how much they change over its width txd
+struct wall_edges {
+	int tx0, txd;
+	int yf0, yfd, yc0, ycd;
+	int nyf0, nyfd, nyc0, nycd;
+};
+
+// evaluate the wall's edges at the n columns starting at x, each clamped to
+//	the part of the column that's still visible (ylo[x]..yhi[x]); portal edges
+//	are only computed for portals
+extern void (*wallSpans)(
+	const struct wall_edges *e, int x, int n, bool portal,
+	const uint16_t *ylo, const uint16_t *yhi,
+	int32_t *yf, int32_t *yc, int32_t *nyf, int32_t *nyc);
+
+#endif